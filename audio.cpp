@@ -0,0 +1,90 @@
+#include "audio.hpp"
+
+#include <exception>
+#include <stdexcept>
+
+#include "byte_order.hpp"
+#include "scheduler.hpp"
+
+Tone_generator::Tone_generator(uint32_t sample_rate, uint32_t frequency, int16_t amplitude)
+    : sample_rate(sample_rate), frequency(frequency), amplitude(amplitude)
+{
+    if(sample_rate == 0 || frequency == 0)
+        throw std::invalid_argument("Sample rate and frequency must be above 0!");
+}
+
+void Tone_generator::render(int16_t* out, size_t samples, bool on) noexcept
+{
+    for(size_t i = 0; i < samples; i++)
+    {
+        if(on && gain < RAMP_SAMPLES)
+            gain++;
+        else if(not on && gain > 0)
+            gain--;
+
+        // one period is sample_rate steps of `frequency`
+        const int32_t level = phase < sample_rate / 2 ? amplitude : -amplitude;
+        out[i] = static_cast<int16_t>(level * gain / RAMP_SAMPLES);
+
+        phase += frequency;
+        if(phase >= sample_rate)
+            phase -= sample_rate;
+    }
+}
+
+Wav_sink::Wav_sink(const std::string& path, uint32_t sample_rate)
+    : file(path, std::ofstream::binary | std::ofstream::out), tone(sample_rate)
+{
+    if(not file.is_open())
+        throw std::invalid_argument("WAV path is invalid!");
+
+    // the sizes are written again once the length is known
+    write_header(0);
+}
+
+Wav_sink::~Wav_sink()
+{
+    file.seekp(0);
+    write_header(static_cast<uint32_t>(samples * sizeof(int16_t)));
+}
+
+void Wav_sink::on_frame(bool tone_on)
+{
+    const uint64_t rate  = tone.get_sample_rate();
+    const uint64_t count = (frames + 1) * rate / Scheduler::FRAME_RATE - frames * rate / Scheduler::FRAME_RATE;
+
+    // the buffers keep their capacity, frames don't allocate after the first
+    buffer.resize(count);
+    tone.render(buffer.data(), buffer.size(), tone_on);
+
+    bytes.resize(count * sizeof(int16_t));
+    for(size_t i = 0; i < count; i++)
+    {
+        bytes[i * 2]     = static_cast<char>(buffer[i] & 0xFF);
+        bytes[i * 2 + 1] = static_cast<char>(buffer[i] >> 8 & 0xFF);
+    }
+
+    file.write(bytes.data(), bytes.size());
+
+    frames++;
+    samples += count;
+}
+
+// RIFF header of 16-bit mono PCM
+void Wav_sink::write_header(uint32_t data_bytes)
+{
+    const uint32_t rate = tone.get_sample_rate();
+
+    file.write("RIFF", 4);
+    write_le<uint32_t>(file, 36 + data_bytes);
+    file.write("WAVEfmt ", 8);
+    write_le<uint32_t>(file, 16);
+    write_le<uint16_t>(file, 1);                      // PCM
+    write_le<uint16_t>(file, 1);                      // mono
+    write_le<uint32_t>(file, rate);
+    write_le<uint32_t>(file, rate * sizeof(int16_t)); // bytes per second
+    write_le<uint16_t>(file, sizeof(int16_t));        // bytes per sample
+    write_le<uint16_t>(file, 16);                     // bits per sample
+    file.write("data", 4);
+    write_le<uint32_t>(file, data_bytes);
+}
@@ -0,0 +1,71 @@
+#ifndef AUDIO_HPP
+#define AUDIO_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Square wave gated by the sound timer. The gain ramps over a few samples
+// when the tone starts or stops so the edges don't click.
+class Tone_generator
+{
+public:
+    enum
+    {
+        DEFAULT_SAMPLE_RATE = 44100,
+        DEFAULT_FREQUENCY   = 440
+    };
+
+    // throws when the sample rate or the frequency is 0
+    Tone_generator(uint32_t sample_rate = DEFAULT_SAMPLE_RATE, uint32_t frequency = DEFAULT_FREQUENCY,
+                   int16_t amplitude = 4000);
+
+    // fill `samples` mono samples, the phase carries over between calls
+    void render(int16_t* out, size_t samples, bool on) noexcept;
+
+    constexpr uint32_t get_sample_rate() const noexcept { return sample_rate; }
+
+private:
+    enum { RAMP_SAMPLES = 64 };
+
+    uint32_t sample_rate;
+    uint32_t frequency;
+    int16_t  amplitude;
+
+    // position in the period, in samples times the frequency
+    uint64_t phase = 0;
+    int32_t  gain  = 0; // 0 to RAMP_SAMPLES
+};
+
+// Writes the tone of a headless run to a 16-bit mono WAV file,
+// one frame of samples at a time in emulated time
+class Wav_sink
+{
+public:
+    // throws when the file can't be created
+    explicit Wav_sink(const std::string& path, uint32_t sample_rate = Tone_generator::DEFAULT_SAMPLE_RATE);
+
+    // fixes the sizes in the header
+    ~Wav_sink();
+
+    Wav_sink(const Wav_sink&) = delete;
+    Wav_sink& operator=(const Wav_sink&) = delete;
+
+    // the samples of one 60Hz frame, the remainder of sample_rate / 60 is spread over the frames
+    void on_frame(bool tone_on);
+
+private:
+    void write_header(uint32_t data_bytes);
+
+    std::ofstream  file;
+    Tone_generator tone;
+    uint64_t       frames  = 0;
+    uint64_t       samples = 0;
+
+    std::vector<int16_t> buffer;
+    std::vector<char>    bytes;
+};
+
+#endif // AUDIO_HPP
@@ -0,0 +1,47 @@
+#include "audio_device.hpp"
+
+#include <exception>
+#include <stdexcept>
+#include <string>
+
+Audio_device::Audio_device(uint16_t buffer_samples, uint32_t sample_rate)
+    : tone(sample_rate)
+{
+    if(buffer_samples == 0 || (buffer_samples & (buffer_samples - 1)) != 0)
+        throw std::invalid_argument("Audio buffer must be a power of two samples!");
+
+    if(SDL_InitSubSystem(SDL_INIT_AUDIO) < 0)
+        throw std::runtime_error(std::string("SDL audio could not initialize! SDL_Error: ") + SDL_GetError());
+
+    SDL_AudioSpec wanted { };
+    wanted.freq     = static_cast<int>(sample_rate);
+    wanted.format   = AUDIO_S16SYS;
+    wanted.channels = 1;
+    wanted.samples  = buffer_samples;
+    wanted.callback = &Audio_device::callback;
+    wanted.userdata = this;
+
+    // SDL converts to whatever the output wants, the tone is always made as asked
+    device = SDL_OpenAudioDevice(nullptr, 0, &wanted, nullptr, 0);
+    if(device == 0)
+    {
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        throw std::runtime_error(std::string("Audio device could not be opened! SDL_Error: ") + SDL_GetError());
+    }
+
+    SDL_PauseAudioDevice(device, 0);
+}
+
+Audio_device::~Audio_device()
+{
+    SDL_CloseAudioDevice(device);
+    SDL_QuitSubSystem(SDL_INIT_AUDIO);
+}
+
+void Audio_device::callback(void* userdata, Uint8* stream, int length) noexcept
+{
+    Audio_device& self = *static_cast<Audio_device*>(userdata);
+
+    const bool on = self.tone_on.load(std::memory_order_relaxed);
+    self.tone.render(reinterpret_cast<int16_t*>(stream), static_cast<size_t>(length) / sizeof(int16_t), on);
+}
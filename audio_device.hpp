@@ -0,0 +1,41 @@
+#ifndef AUDIO_DEVICE_HPP
+#define AUDIO_DEVICE_HPP
+
+#include <SDL2/SDL.h>
+
+#include <atomic>
+#include <cstdint>
+
+#include "audio.hpp"
+
+// Plays the tone through SDL. The callback runs on SDL's audio thread and only
+// reads the tone flag, the emulation never waits on it. Smaller buffers answer
+// the sound timer sooner, larger ones survive a busy host without underruns.
+class Audio_device
+{
+public:
+    enum { DEFAULT_BUFFER_SAMPLES = 512 };
+
+    // throws when the buffer isn't a power of two or SDL can't open an output
+    explicit Audio_device(uint16_t buffer_samples = DEFAULT_BUFFER_SAMPLES,
+                          uint32_t sample_rate = Tone_generator::DEFAULT_SAMPLE_RATE);
+    ~Audio_device();
+
+    Audio_device(const Audio_device&) = delete;
+    Audio_device& operator=(const Audio_device&) = delete;
+
+    // hand it to Chip8::set_sound_flag()
+    std::atomic<bool>& get_tone_flag() noexcept { return tone_on; }
+
+private:
+    static void callback(void* userdata, Uint8* stream, int length) noexcept;
+
+    SDL_AudioDeviceID device = 0;
+
+    // only touched by the audio thread once the device runs
+    Tone_generator tone;
+
+    std::atomic<bool> tone_on { false };
+};
+
+#endif // AUDIO_DEVICE_HPP
@@ -0,0 +1,58 @@
+#ifndef BYTE_ORDER_HPP
+#define BYTE_ORDER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+
+// Every file format here is little-endian. Integers are written and read
+// byte by byte so the files don't depend on the host.
+
+// returns the byte after `value`
+template<typename T>
+uint8_t* put_le(uint8_t* out, T value) noexcept
+{
+    for(size_t i = 0; i < sizeof(T); i++)
+        *out++ = static_cast<uint8_t>(value >> (i * 8) & 0xFF);
+
+    return out;
+}
+
+// returns the byte after `value`
+template<typename T>
+const uint8_t* get_le(const uint8_t* in, T& value) noexcept
+{
+    value = 0;
+    for(size_t i = 0; i < sizeof(T); i++)
+        value |= static_cast<T>(static_cast<T>(*in++) << (i * 8));
+
+    return in;
+}
+
+template<typename T>
+void write_le(std::ostream& out, T value)
+{
+    for(size_t i = 0; i < sizeof(T); i++)
+        out.put(static_cast<char>(value >> (i * 8) & 0xFF));
+}
+
+// returns false when the stream ends first
+template<typename T>
+bool read_le(std::istream& in, T& value)
+{
+    value = 0;
+    for(size_t i = 0; i < sizeof(T); i++)
+    {
+        const int byte = in.get();
+        if(byte == std::char_traits<char>::eof())
+            return false;
+
+        value |= static_cast<T>(static_cast<T>(byte) << (i * 8));
+    }
+
+    return true;
+}
+
+#endif // BYTE_ORDER_HPP
@@ -0,0 +1,192 @@
+#include "capture.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+#include "byte_order.hpp"
+
+namespace
+{
+    constexpr char MAGIC[4] = { 'C', '8', 'F', 'D' };
+
+    // frames drained and written at once
+    constexpr size_t BATCH_SIZE = 256;
+
+    constexpr size_t RAW_FRAME_BYTES = CHIP8_WIDTH * CHIP8_HEIGHT;
+
+    // 8 pixels of 0 or 255 for every byte of a row, the first pixel is the highest bit
+    std::array<std::array<uint8_t, 8>, 256> make_expansion() noexcept
+    {
+        std::array<std::array<uint8_t, 8>, 256> table { };
+        for(size_t byte = 0; byte < table.size(); byte++)
+        {
+            for(size_t bit = 0; bit < 8; bit++)
+                table[byte][bit] = static_cast<uint8_t>(0 - (byte >> (7 - bit) & 1));
+        }
+
+        return table;
+    }
+
+    const std::array<std::array<uint8_t, 8>, 256> EXPANSION = make_expansion();
+
+    // FNV-1a over whole rows, enough to tell frames apart
+    template<typename Display>
+    uint64_t hash_display(const Display& display) noexcept
+    {
+        uint64_t hash = 0xCBF29CE484222325;
+        for(uint64_t row : display)
+            hash = (hash ^ row) * 0x100000001B3;
+
+        return hash;
+    }
+}
+
+Capture::Capture(const std::string& path, Format format, uint64_t keyframe_interval, const std::string& keyframe_prefix)
+    : file(path, std::ofstream::binary | std::ofstream::out),
+      format(format),
+      keyframe_interval(keyframe_interval),
+      keyframe_prefix(keyframe_prefix)
+{
+    if(not file.is_open())
+        throw std::invalid_argument("Capture path is invalid!");
+
+    if(format == Format::DELTA)
+    {
+        uint8_t header[sizeof(MAGIC) + 6];
+        std::copy(MAGIC, MAGIC + sizeof(MAGIC), header);
+
+        uint8_t* out = put_le<uint16_t>(header + sizeof(MAGIC), VERSION);
+        out = put_le<uint16_t>(out, CHIP8_WIDTH);
+        put_le<uint16_t>(out, CHIP8_HEIGHT);
+
+        file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    }
+
+    // the largest a batch can get
+    bytes.resize(BATCH_SIZE * std::max<size_t>(RAW_FRAME_BYTES, 12 + sizeof(Packed_display)));
+
+    // a pipe should see a frame as soon as it's done
+    ring.start(BATCH_SIZE, [this](const Frame* batch, size_t count) { write_batch(batch, count); },
+               [this] { file.flush(); }, [this] { write_end(); });
+}
+
+Capture::~Capture()
+{
+    end_frame = frames;
+    ring.stop();
+}
+
+void Capture::on_frame(const Chip8& chip) noexcept
+{
+    const uint64_t number = frames++;
+
+    // nothing was drawn since the last frame, the hash can't have changed
+    if(has_frame && chip.get_display_generation() == generation)
+        return;
+
+    generation = chip.get_display_generation();
+
+    // drawing the same pixels again doesn't make a new frame
+    const uint64_t hash = hash_display(chip.display);
+    if(has_frame && hash == last_hash)
+        return;
+
+    has_frame = true;
+    last_hash = hash;
+    captured++;
+
+    ring.push({ number, chip.display });
+}
+
+void Capture::write_batch(const Frame* batch, size_t count)
+{
+    uint8_t* out = bytes.data();
+    for(size_t i = 0; i < count; i++)
+    {
+        const Frame& frame = batch[i];
+
+        if(format == Format::RAW)
+        {
+            if(frame.number > next_number)
+            {
+                file.write(reinterpret_cast<const char*>(bytes.data()), out - bytes.data());
+                out = bytes.data();
+
+                write_repeats(frame.number - next_number);
+            }
+
+            uint8_t* pixel = raw.data();
+            for(uint64_t row : frame.display)
+            {
+                for(int shift = 56; shift >= 0; shift -= 8)
+                    pixel = std::copy_n(EXPANSION[row >> shift & 0xFF].data(), 8, pixel);
+            }
+
+            out = std::copy(raw.begin(), raw.end(), out);
+            next_number = frame.number + 1;
+        }
+        else
+        {
+            uint32_t changed = first ? 0xFFFFFFFF : 0;
+            for(size_t y = 0; y < frame.display.size(); y++)
+            {
+                if(frame.display[y] != previous[y])
+                    changed |= 1u << y;
+            }
+
+            out = put_le(out, frame.number);
+            out = put_le(out, changed);
+            for(size_t y = 0; y < frame.display.size(); y++)
+            {
+                if(changed >> y & 1)
+                    out = put_le(out, frame.display[y]);
+            }
+        }
+
+        previous = frame.display;
+        first    = false;
+
+        if(keyframe_interval > 0 && frame.number >= next_keyframe)
+        {
+            write_keyframe(frame);
+            next_keyframe = (frame.number / keyframe_interval + 1) * keyframe_interval;
+        }
+    }
+
+    file.write(reinterpret_cast<const char*>(bytes.data()), out - bytes.data());
+}
+
+void Capture::write_end()
+{
+    // the frames after the last change
+    if(format == Format::RAW && not first)
+        write_repeats(end_frame - next_number);
+
+    file.flush();
+}
+
+void Capture::write_repeats(uint64_t count)
+{
+    for(uint64_t i = 0; i < count; i++)
+        file.write(reinterpret_cast<const char*>(raw.data()), raw.size());
+}
+
+// binary PPM, lit pixels are white
+void Capture::write_keyframe(const Frame& frame)
+{
+    std::ofstream image(keyframe_prefix + std::to_string(frame.number) + ".ppm", std::ofstream::binary | std::ofstream::out);
+    image << "P6\n" << CHIP8_WIDTH << " " << CHIP8_HEIGHT << "\n255\n";
+
+    std::array<char, CHIP8_WIDTH * 3> pixels;
+    for(uint64_t row : frame.display)
+    {
+        for(int x = 0; x < CHIP8_WIDTH; x++)
+        {
+            const char value = static_cast<char>(0 - (row >> (63 - x) & 1));
+            std::fill_n(pixels.begin() + x * 3, 3, value);
+        }
+
+        image.write(pixels.data(), pixels.size());
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef CAPTURE_HPP
+#define CAPTURE_HPP
+
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "chip8.hpp"
+#include "ring_writer.hpp"
+
+// Records what a machine displayed, one emulated frame at a time.
+// Frames equal to the last captured one are dropped by hash on the emulation
+// thread, the rest go through a ring as packed rows and a thread of the
+// capture expands, encodes and writes them, so the emulation only copies 256 bytes.
+//
+// RAW writes every frame as 64x32 bytes, 0 or 255, without a header, ready for
+// an encoder reading 60fps gray raw video from a pipe. The writer repeats the
+// last frame over the dropped ones, so the stream keeps its rate.
+// DELTA is little-endian: "C8FD", uint16 version, uint16 width, uint16 height,
+// then per captured frame: uint64 frame, uint32 changed rows (bit 0 is the top row)
+// and a uint64 per changed row, bit 63 is the leftmost pixel.
+// Every `keyframe_interval` frames the next captured frame is also written
+// as `<keyframe_prefix><frame>.ppm`.
+class Capture
+{
+public:
+    enum class Format : uint8_t
+    {
+        RAW,
+        DELTA
+    };
+
+    enum { VERSION = 1 };
+
+    // throws when a file can't be created, no keyframes when the interval is 0
+    Capture(const std::string& path, Format format, uint64_t keyframe_interval = 0,
+            const std::string& keyframe_prefix = "");
+
+    // writes every frame still in the ring
+    ~Capture();
+
+    Capture(const Capture&) = delete;
+    Capture& operator=(const Capture&) = delete;
+
+    // call once per emulated frame from the emulation thread,
+    // waits for the writer when the ring is full so no frame is lost
+    void on_frame(const Chip8& chip) noexcept;
+
+    constexpr uint64_t get_frames() const noexcept { return frames; }
+    constexpr uint64_t get_captured() const noexcept { return captured; }
+
+    // how many times on_frame() found the ring full
+    uint64_t get_stalls() const noexcept { return ring.get_stalls(); }
+
+private:
+    enum { RING_SIZE = 4096 };
+
+    using Packed_display = decltype(Chip8::display);
+
+    struct Frame
+    {
+        uint64_t       number;
+        Packed_display display;
+    };
+
+    void write_batch(const Frame* batch, size_t count);
+    void write_end();
+    void write_repeats(uint64_t count);
+    void write_keyframe(const Frame& frame);
+
+    std::ofstream file;
+    Format        format;
+    uint64_t      keyframe_interval;
+    std::string   keyframe_prefix;
+
+    // emulation side
+    uint64_t frames     = 0;
+    uint64_t captured   = 0;
+    uint64_t last_hash  = 0;
+    uint64_t generation = 0;
+    bool     has_frame  = false;
+
+    // writer side
+    std::vector<uint8_t> bytes;
+    Packed_display       previous { };
+    bool                 first         = true;
+    uint64_t             next_keyframe = 0;
+
+    // RAW: the last frame as written and the number of the frame after it
+    std::array<uint8_t, CHIP8_WIDTH * CHIP8_HEIGHT> raw { };
+    uint64_t next_number = 0;
+
+    // read by the writer once it sees the stop
+    uint64_t end_frame = 0;
+
+    Ring_writer<Frame, RING_SIZE> ring;
+};
+
+#endif // CAPTURE_HPP
@@ -1,80 +1,131 @@
 #include "chip8.hpp"
+#include "jit.hpp"
+#include "rom.hpp"
+#include "profiler.hpp"
+#include "tracer.hpp"
+#include "byte_order.hpp"
 
 #include <fstream>
 #include <exception>
-#include <iostream>
-#include <sstream>
-#include <iomanip>
 #include <algorithm>
 #include <random>
 #include <initializer_list>
-#include <limits>
+#include <cassert>
 
-Chip8::Chip8(const std::string& file_path)
-{
-    std::ifstream file(file_path, std::ifstream::ate    | // start from the end
-                                  std::ifstream::binary | // file is binary
-                                  std::ifstream::in);     // planning on only input
+// the interpreter loop is only fast with the handlers inlined into it
+#if defined(__GNUC__) || defined(__clang__)
+#define CHIP8_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define CHIP8_ALWAYS_INLINE inline
+#endif
+
+const std::array<Chip8::Opcode_id, 0x10000> Chip8::decode_table = Chip8::make_decode_table();
 
-    if(file.is_open())
+std::array<Chip8::Opcode_id, 0x10000> Chip8::make_decode_table() noexcept
+{
+    struct Opcode_pattern
     {
-        // get file size in bytes
-        const std::streampos size = file.tellg();
-
-        // start reading in the beginning
-        file.seekg(0, std::ios::beg);
-
-        // File read expecting char*
-        file.read(reinterpret_cast<char*>(memory.data() + LOCATION_START), size);
-   
-        copy_fonts_to_memory();
-
-        // Starting position of CPU
-        pc = LOCATION_START;
-
-        // setting up the opcode table
-        // opcode_table[OPCODE_0NNN] = [this](){ OPCODE_0NNN_Impl(); };
-        opcode_table[OPCODE_00E0] = [this](){ OPCODE_00E0_Impl(); };
-        opcode_table[OPCODE_00EE] = [this](){ OPCODE_00EE_Impl(); };
-        opcode_table[OPCODE_1NNN] = [this](){ OPCODE_1NNN_Impl(); };
-        opcode_table[OPCODE_2NNN] = [this](){ OPCODE_2NNN_Impl(); };
-        opcode_table[OPCODE_3XKK] = [this](){ OPCODE_3XKK_Impl(); };
-        opcode_table[OPCODE_4XKK] = [this](){ OPCODE_4XKK_Impl(); };
-        opcode_table[OPCODE_5XY0] = [this](){ OPCODE_5XY0_Impl(); };
-        opcode_table[OPCODE_6XKK] = [this](){ OPCODE_6XKK_Impl(); };
-        opcode_table[OPCODE_7XKK] = [this](){ OPCODE_7XKK_Impl(); };
-        opcode_table[OPCODE_8XY0] = [this](){ OPCODE_8XY0_Impl(); };
-        opcode_table[OPCODE_8XY1] = [this](){ OPCODE_8XY1_Impl(); };
-        opcode_table[OPCODE_8XY2] = [this](){ OPCODE_8XY2_Impl(); };
-        opcode_table[OPCODE_8XY3] = [this](){ OPCODE_8XY3_Impl(); };
-        opcode_table[OPCODE_8XY4] = [this](){ OPCODE_8XY4_Impl(); };
-        opcode_table[OPCODE_8XY5] = [this](){ OPCODE_8XY5_Impl(); };
-        opcode_table[OPCODE_8XY6] = [this](){ OPCODE_8XY6_Impl(); };
-        opcode_table[OPCODE_8XY7] = [this](){ OPCODE_8XY7_Impl(); };
-        opcode_table[OPCODE_8XYE] = [this](){ OPCODE_8XYE_Impl(); };
-        opcode_table[OPCODE_9XY0] = [this](){ OPCODE_9XY0_Impl(); };
-        opcode_table[OPCODE_ANNN] = [this](){ OPCODE_ANNN_Impl(); };
-        opcode_table[OPCODE_BNNN] = [this](){ OPCODE_BNNN_Impl(); };
-        opcode_table[OPCODE_CXKK] = [this](){ OPCODE_CXKK_Impl(); };
-        opcode_table[OPCODE_DXYN] = [this](){ OPCODE_DXYN_Impl(); };
-        opcode_table[OPCODE_EX9E] = [this](){ OPCODE_EX9E_Impl(); };
-        opcode_table[OPCODE_EXA1] = [this](){ OPCODE_EXA1_Impl(); };
-        opcode_table[OPCODE_FX07] = [this](){ OPCODE_FX07_Impl(); };
-        opcode_table[OPCODE_FX0A] = [this](){ OPCODE_FX0A_Impl(); };
-        opcode_table[OPCODE_FX15] = [this](){ OPCODE_FX15_Impl(); };
-        opcode_table[OPCODE_FX18] = [this](){ OPCODE_FX18_Impl(); };
-        opcode_table[OPCODE_FX1E] = [this](){ OPCODE_FX1E_Impl(); };
-        opcode_table[OPCODE_FX29] = [this](){ OPCODE_FX29_Impl(); };
-        opcode_table[OPCODE_FX33] = [this](){ OPCODE_FX33_Impl(); };
-        opcode_table[OPCODE_FX55] = [this](){ OPCODE_FX55_Impl(); };
-        opcode_table[OPCODE_FX65] = [this](){ OPCODE_FX65_Impl(); };
-    }
-    else
+        uint16_t  opcode;
+        uint16_t  mask;
+        Opcode_id id;
+    };
+
+    // the mask tells which bits identify the instruction,
+    // every other bit is an operand
+    static constexpr Opcode_pattern patterns[] {
+        { OPCODE_00E0, 0xF00F, ID_00E0 }, { OPCODE_00EE, 0xF00F, ID_00EE },
+        { OPCODE_1NNN, 0xF000, ID_1NNN }, { OPCODE_2NNN, 0xF000, ID_2NNN },
+        { OPCODE_3XKK, 0xF000, ID_3XKK }, { OPCODE_4XKK, 0xF000, ID_4XKK },
+        { OPCODE_5XY0, 0xF000, ID_5XY0 }, { OPCODE_6XKK, 0xF000, ID_6XKK },
+        { OPCODE_7XKK, 0xF000, ID_7XKK }, { OPCODE_8XY0, 0xF00F, ID_8XY0 },
+        { OPCODE_8XY1, 0xF00F, ID_8XY1 }, { OPCODE_8XY2, 0xF00F, ID_8XY2 },
+        { OPCODE_8XY3, 0xF00F, ID_8XY3 }, { OPCODE_8XY4, 0xF00F, ID_8XY4 },
+        { OPCODE_8XY5, 0xF00F, ID_8XY5 }, { OPCODE_8XY6, 0xF00F, ID_8XY6 },
+        { OPCODE_8XY7, 0xF00F, ID_8XY7 }, { OPCODE_8XYE, 0xF00F, ID_8XYE },
+        { OPCODE_9XY0, 0xF000, ID_9XY0 }, { OPCODE_ANNN, 0xF000, ID_ANNN },
+        { OPCODE_BNNN, 0xF000, ID_BNNN }, { OPCODE_CXKK, 0xF000, ID_CXKK },
+        { OPCODE_DXYN, 0xF000, ID_DXYN }, { OPCODE_EX9E, 0xF00F, ID_EX9E },
+        { OPCODE_EXA1, 0xF00F, ID_EXA1 }, { OPCODE_FX07, 0xF0FF, ID_FX07 },
+        { OPCODE_FX0A, 0xF0FF, ID_FX0A }, { OPCODE_FX15, 0xF0FF, ID_FX15 },
+        { OPCODE_FX18, 0xF0FF, ID_FX18 }, { OPCODE_FX1E, 0xF0FF, ID_FX1E },
+        { OPCODE_FX29, 0xF0FF, ID_FX29 }, { OPCODE_FX33, 0xF0FF, ID_FX33 },
+        { OPCODE_FX55, 0xF0FF, ID_FX55 }, { OPCODE_FX65, 0xF0FF, ID_FX65 }
+    };
+
+    // anything that matches no pattern stays illegal
+    std::array<Opcode_id, 0x10000> table;
+    table.fill(ID_ILLEGAL);
+
+    // every pattern only has to look at the 4096 opcodes of its own group
+    for(const auto& pattern : patterns)
     {
-        throw std::invalid_argument("Path is invalid!");
+        const uint32_t group = pattern.opcode & 0xF000;
+
+        for(uint32_t opcode = group; opcode < group + 0x1000; opcode++)
+        {
+            if((opcode & pattern.mask) == pattern.opcode)
+                table[opcode] = pattern.id;
+        }
     }
+
+    return table;
 }
 
+Chip8::Chip8(const std::string& file_path)
+    : Chip8(Rom_file(file_path))
+{
+}
+
+Chip8::Chip8(const Rom_file& rom)
+    : Chip8(rom.data(), rom.size())
+{
+}
+
+Chip8::Chip8(const uint8_t* rom, size_t size)
+{
+    if(size > MAX_ROM_SIZE)
+        throw std::length_error("ROM doesn't fit in memory!");
+
+    std::copy(rom, rom + size, memory.begin() + LOCATION_START);
+    copy_fonts_to_memory();
+
+    // Starting position of CPU
+    pc = LOCATION_START;
+
+    // unpredictable unless the caller seeds it again
+    seed(std::random_device{}());
+}
+
+Chip8::Chip8(const State& state) noexcept
+{
+    load_state(state);
+}
+
+// everything but the JIT, its code buffer belongs to one machine
+Chip8::Chip8(const Chip8& other) noexcept
+    : CPU(other),
+      inst_var(other.inst_var),
+      trap(other.trap),
+      trap_address(other.trap_address),
+      rng_seed(other.rng_seed),
+      rng_state(other.rng_state),
+      cycles(other.cycles),
+      dirty_rows(other.dirty_rows),
+      display_generation(other.display_generation),
+      pending_idle(other.pending_idle),
+      idle(other.idle),
+      decode_cache(other.decode_cache),
+      use_decode_cache(other.use_decode_cache),
+      use_fusion(other.use_fusion),
+      fusion_counts(other.fusion_counts)
+{
+}
+
+Chip8::Chip8(Chip8&& other) noexcept = default;
+
+// Jit is only complete here
+Chip8::~Chip8() = default;
+
 void Chip8::copy_fonts_to_memory() noexcept
 {
     static constexpr std::initializer_list<int> fontset {
@@ -100,154 +151,714 @@ void Chip8::copy_fonts_to_memory() noexcept
     std::copy(fontset.begin(), fontset.end(), memory.begin());
 }
 
-#if ENABLE_DEBUG_MODE
-std::string Chip8::get_memory_as_string(size_t min, size_t max) const noexcept
+void Chip8::fetch_opcode() noexcept
+{
+    // shifting to left the memory[pc] by 8 bits
+    // and then assign the next memory by using bitwise OR operation
+    // example: a2 bc turns to 0xA2BC
+    opcode = (memory[pc] << 8) | memory[pc + 1];
+}
+
+void Chip8::fetch_instruction_variables() noexcept {
+    inst_var = decode_variables(opcode);
+}
+
+Chip8::Instruction_variables Chip8::decode_variables(uint16_t opcode) noexcept
 {
-    std::stringstream ss;
+    Instruction_variables vars;
 
-    // telling the stream that the characters are going to be hexadecimals
-    // and if there is no character put 0 instead
-    ss << std::hex << std::setfill('0');
+    // A 12-bit value, the lowest 12 bits of the instruction
+    vars.nnn = opcode & 0xFFF;      // addr
+    // A 4-bit value, the lowest 4 bits of the instruction
+    vars.n   = opcode & 0xF;        // nibble
+    // A 4-bit value, the lower 4 bits of the high byte of the instruction
+    vars.x   = (opcode >> 8) & 0xF; // x-axis
+    // A 4-bit value, the upper 4 bits of the low byte of the instruction
+    vars.y   = (opcode >> 4) & 0xF; // y-axis
+    // An 8-bit value, the lowest 8 bits of the instruction
+    vars.kk  = opcode & 0xFF;       // byte
+
+    return vars;
+}
 
-    for(size_t i = 0; i < memory.size(); i++)
+void Chip8::predecode(size_t cache_index) noexcept
+{
+    const uint16_t address = LOCATION_START + cache_index * INSTRUCTION_LONG;
+    Decoded_instruction& entry = decode_cache[cache_index];
+
+    entry.opcode = (memory[address] << 8) | memory[address + 1];
+    entry.vars   = decode_variables(entry.opcode);
+    entry.id     = decode(entry.opcode);
+}
+
+// Look at the words following `cache_index` for a sequence worth fusing,
+// the words it looks at are decoded into the cache on the way
+Chip8::Fusion Chip8::detect_fusion(size_t cache_index) noexcept
+{
+    Opcode_id ids[3] { decode_cache[cache_index].id, ID_ILLEGAL, ID_ILLEGAL };
+
+    for(size_t i = 1; i < 3 && cache_index + i < decode_cache.size(); i++)
     {
-        // make sure i is between min and max
-        if(i >= min && i <= max)
-        {
-            // pushing the character into the stream and make sure it's 2 letter;
-            ss << " " << std::setw(2) << +memory[i] << " " << opcode << "  ";
-        }
+        // a word that is already valid is decoded from the same memory
+        predecode(cache_index + i);
+        ids[i] = decode_cache[cache_index + i].id;
     }
 
-    return ss.str();
+    if(ids[2] == ID_1NNN)
+    {
+        if(ids[0] == ID_7XKK && ids[1] == ID_3XKK) return Fusion::COUNT_EQUAL_LOOP;
+        if(ids[0] == ID_7XKK && ids[1] == ID_4XKK) return Fusion::COUNT_NOT_EQUAL_LOOP;
+        if(ids[0] == ID_FX07 && ids[1] == ID_3XKK) return Fusion::POLL_DELAY_EQUAL;
+        if(ids[0] == ID_FX07 && ids[1] == ID_4XKK) return Fusion::POLL_DELAY_NOT_EQUAL;
+    }
+
+    if(ids[0] == ID_3XKK && ids[1] == ID_1NNN) return Fusion::SKIP_EQUAL_JUMP;
+    if(ids[0] == ID_4XKK && ids[1] == ID_1NNN) return Fusion::SKIP_NOT_EQUAL_JUMP;
+    if(ids[0] == ID_ANNN && ids[1] == ID_DXYN) return Fusion::LOAD_DRAW;
+
+    return Fusion::NONE;
+}
+
+template<Chip8::Opcode_handler... handlers>
+uint32_t Chip8::execute_fused(size_t cache_index) noexcept
+{
+    uint32_t executed = 0;
+    const uint16_t address = pc;
+
+    // a taken skip or jump moves pc away from the next word and ends the sequence,
+    // the handlers are known here so every call is a direct one
+    ((pc == address + executed * INSTRUCTION_LONG ? ([&]()
+    {
+        const Decoded_instruction& entry = decode_cache[cache_index + executed];
+
+        opcode   = entry.opcode;
+        inst_var = entry.vars;
+        pc += INSTRUCTION_LONG;
+
+        (this->*handlers)();
+        executed++;
+    }(), 0) : 0), ...);
+
+    return executed;
 }
 
-void Chip8::clear_terminal() const noexcept
+const std::array<Chip8::Fused_handler, static_cast<size_t>(Chip8::Fusion::COUNT)> Chip8::fused_table {
+    nullptr,
+    &Chip8::execute_fused<&Chip8::OPCODE_3XKK_Impl, &Chip8::OPCODE_1NNN_Impl>,
+    &Chip8::execute_fused<&Chip8::OPCODE_4XKK_Impl, &Chip8::OPCODE_1NNN_Impl>,
+    &Chip8::execute_fused<&Chip8::OPCODE_ANNN_Impl, &Chip8::OPCODE_DXYN_Impl>,
+    &Chip8::execute_fused<&Chip8::OPCODE_7XKK_Impl, &Chip8::OPCODE_3XKK_Impl, &Chip8::OPCODE_1NNN_Impl>,
+    &Chip8::execute_fused<&Chip8::OPCODE_7XKK_Impl, &Chip8::OPCODE_4XKK_Impl, &Chip8::OPCODE_1NNN_Impl>,
+    &Chip8::execute_fused<&Chip8::OPCODE_FX07_Impl, &Chip8::OPCODE_3XKK_Impl, &Chip8::OPCODE_1NNN_Impl>,
+    &Chip8::execute_fused<&Chip8::OPCODE_FX07_Impl, &Chip8::OPCODE_4XKK_Impl, &Chip8::OPCODE_1NNN_Impl>
+};
+
+const std::array<uint8_t, static_cast<size_t>(Chip8::Fusion::COUNT)> Chip8::fusion_length {
+    1, 2, 2, 2, 3, 3, 3, 3
+};
+
+void Chip8::set_fusion(bool enabled) noexcept {
+    use_fusion = enabled;
+}
+
+uint64_t Chip8::get_fusion_count(Fusion fusion) const noexcept {
+    return fusion_counts[static_cast<size_t>(fusion)];
+}
+
+const char* Chip8::get_fusion_name(Fusion fusion) noexcept
 {
-    // UGHHH std::system is being used
-    #if __linux__
-    std::system("clear");
-    #elif _WIN32
-    std::system("cls");
-    #endif
+    static constexpr const char* names[] {
+        "none",
+        "3XKK+1NNN",
+        "4XKK+1NNN",
+        "ANNN+DXYN",
+        "7XKK+3XKK+1NNN",
+        "7XKK+4XKK+1NNN",
+        "FX07+3XKK+1NNN",
+        "FX07+4XKK+1NNN"
+    };
+
+    return names[static_cast<size_t>(fusion)];
 }
-#endif // ENABLE_DEBUG_MODE
 
-void Chip8::fetch_opcode() noexcept
+const char* Chip8::get_trap_name(Trap trap) noexcept
 {
-    // shifting to left the memory[pc] by 8 bits
-    // and then assign the next memory by using bitwise OR operation
-    // example: a2 bc turns to 0xA2BC
-    opcode = (memory[pc] << 8) | memory[pc + 1];
+    static constexpr const char* names[] {
+        "none",
+        "illegal opcode",
+        "stack overflow",
+        "stack underflow",
+        "memory out of range"
+    };
+
+    // a trap loaded from a corrupt state may be anything
+    if(trap >= Trap::COUNT)
+        return "unknown";
+
+    return names[static_cast<size_t>(trap)];
 }
 
-void Chip8::fetch_instruction_variables() noexcept
+const char* Chip8::get_opcode_name(size_t opcode_class) noexcept
 {
-    // A 12-bit value, the lowest 12 bits of the instruction
-    inst_var.nnn = opcode & 0xFFF;      // addr
-    // A 4-bit value, the lowest 4 bits of the instruction
-    inst_var.n   = opcode & 0xF;        // nibble
-    // A 4-bit value, the lower 4 bits of the high byte of the instruction
-    inst_var.x   = (opcode >> 8) & 0xF; // x-axis
-    // A 4-bit value, the upper 4 bits of the low byte of the instruction
-    inst_var.y   = (opcode >> 4) & 0xF; // y-axis
-    // An 8-bit value, the lowest 8 bits of the instruction
-    inst_var.kk  = opcode & 0xFF;       // byte
+    static constexpr const char* names[OPCODE_ID_COUNT] {
+        "illegal",
+        "00E0", "00EE", "1NNN", "2NNN", "3XKK", "4XKK", "5XY0",
+        "6XKK", "7XKK", "8XY0", "8XY1", "8XY2", "8XY3", "8XY4",
+        "8XY5", "8XY6", "8XY7", "8XYE", "9XY0", "ANNN", "BNNN",
+        "CXKK", "DXYN", "EX9E", "EXA1", "FX07", "FX0A", "FX15",
+        "FX18", "FX1E", "FX29", "FX33", "FX55", "FX65"
+    };
+
+    return names[opcode_class];
+}
+
+void Chip8::set_decode_cache(bool enabled) noexcept
+{
+    // start from an empty cache so nothing decoded earlier survives
+    decode_cache.fill({ });
+    use_decode_cache = enabled;
+}
+
+// forget every cached word and compiled block that overlaps the written bytes
+void Chip8::invalidate_code(uint16_t address, size_t length) noexcept
+{
+    if(jit)
+        jit->invalidate(address, length);
+
+    // a fused sequence starting up to five bytes before the write reads it as well
+    const size_t first = address > LOCATION_START + 5 ? address - 5 : LOCATION_START;
+    const size_t last  = address + length;
+
+    for(size_t i = first; i < last; i++)
+    {
+        const size_t cache_index = (i - LOCATION_START) / 2;
+
+        if(cache_index < decode_cache.size())
+            decode_cache[cache_index].valid = false;
+    }
 }
 
-// generating a random byte
-uint8_t Chip8::random_byte() const noexcept
+void Chip8::seed(uint64_t new_seed) noexcept
 {
-    std::random_device rd;
-    std::mt19937 eng(rd());
-    std::uniform_int_distribution<> distr(0, 255);
-    
-    return distr(eng);
+    rng_seed  = new_seed;
+    rng_state = new_seed;
+}
+
+// generating a random byte, splitmix64 is cheap and any seed works
+uint8_t Chip8::random_byte() noexcept
+{
+    uint64_t z = (rng_state += 0x9E3779B97F4A7C15);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+    z ^= z >> 31;
+
+    return static_cast<uint8_t>(z >> 56);
+}
+
+// One switch instead of a table of member pointers: the compiler turns it into
+// a single jump table and inlines every handler into its case
+CHIP8_ALWAYS_INLINE void Chip8::execute(Opcode_id id) noexcept
+{
+    switch(id)
+    {
+    case ID_00E0: OPCODE_00E0_Impl(); break;
+    case ID_00EE: OPCODE_00EE_Impl(); break;
+    case ID_1NNN: OPCODE_1NNN_Impl(); break;
+    case ID_2NNN: OPCODE_2NNN_Impl(); break;
+    case ID_3XKK: OPCODE_3XKK_Impl(); break;
+    case ID_4XKK: OPCODE_4XKK_Impl(); break;
+    case ID_5XY0: OPCODE_5XY0_Impl(); break;
+    case ID_6XKK: OPCODE_6XKK_Impl(); break;
+    case ID_7XKK: OPCODE_7XKK_Impl(); break;
+    case ID_8XY0: OPCODE_8XY0_Impl(); break;
+    case ID_8XY1: OPCODE_8XY1_Impl(); break;
+    case ID_8XY2: OPCODE_8XY2_Impl(); break;
+    case ID_8XY3: OPCODE_8XY3_Impl(); break;
+    case ID_8XY4: OPCODE_8XY4_Impl(); break;
+    case ID_8XY5: OPCODE_8XY5_Impl(); break;
+    case ID_8XY6: OPCODE_8XY6_Impl(); break;
+    case ID_8XY7: OPCODE_8XY7_Impl(); break;
+    case ID_8XYE: OPCODE_8XYE_Impl(); break;
+    case ID_9XY0: OPCODE_9XY0_Impl(); break;
+    case ID_ANNN: OPCODE_ANNN_Impl(); break;
+    case ID_BNNN: OPCODE_BNNN_Impl(); break;
+    case ID_CXKK: OPCODE_CXKK_Impl(); break;
+    case ID_DXYN: OPCODE_DXYN_Impl(); break;
+    case ID_EX9E: OPCODE_EX9E_Impl(); break;
+    case ID_EXA1: OPCODE_EXA1_Impl(); break;
+    case ID_FX07: OPCODE_FX07_Impl(); break;
+    case ID_FX0A: OPCODE_FX0A_Impl(); break;
+    case ID_FX15: OPCODE_FX15_Impl(); break;
+    case ID_FX18: OPCODE_FX18_Impl(); break;
+    case ID_FX1E: OPCODE_FX1E_Impl(); break;
+    case ID_FX29: OPCODE_FX29_Impl(); break;
+    case ID_FX33: OPCODE_FX33_Impl(); break;
+    case ID_FX55: OPCODE_FX55_Impl(); break;
+    case ID_FX65: OPCODE_FX65_Impl(); break;
+    default:      OPCODE_ILLEGAL_Impl(); break;
+    }
 }
 
 void Chip8::cycle() noexcept
 {
-    // printing out all of the memory
-    #if ENABLE_DEBUG_MODE
-    clear_terminal();
-    std::cout << std::hex << get_memory_as_string(LOCATION_START, 1000) << std::endl;
-    #endif // ENABLE_DEBUG_MODE
+    step(1);
+}
 
-    fetch_opcode();
+// Execute the instruction at pc, or a whole fused sequence when
+// it fits in the budget, returns how many instructions were executed
+uint32_t Chip8::step(uint64_t budget) noexcept
+{
+    uint32_t executed = 1;
+    const size_t cache_index = (pc - LOCATION_START) / 2;
 
-    // All instructions are 2 bytes long.
-    pc += INSTRUCTION_LONG;
+    if(use_decode_cache && pc >= LOCATION_START && 
+       pc % 2 == 0 && cache_index < decode_cache.size())
+    {
+        Decoded_instruction& entry = decode_cache[cache_index];
 
-    fetch_instruction_variables();
-    call_opcodes();
+        // first time this word is executed, decode it the slow way
+        if(not entry.valid)
+        {
+            predecode(cache_index);
+            entry.fusion = detect_fusion(cache_index);
+            entry.valid  = true;
+        }
+
+        const auto fusion = static_cast<size_t>(entry.fusion);
+
+        if(use_fusion && entry.fusion != Fusion::NONE && budget >= fusion_length[fusion])
+        {
+            const uint16_t address = pc;
+            executed = (this->*fused_table[fusion])(cache_index);
+            fusion_counts[fusion]++;
+
+            // the poll jumped back to its FX07 without the skip being taken
+            if(executed == 3 && pc == address &&
+               (entry.fusion == Fusion::POLL_DELAY_EQUAL || entry.fusion == Fusion::POLL_DELAY_NOT_EQUAL))
+                pending_idle = Idle::DELAY;
+        }
+        else
+        {
+            opcode   = entry.opcode;
+            inst_var = entry.vars;
+            pc += INSTRUCTION_LONG;
+
+            execute(entry.id);
+        }
+    }
+    else if(pc > MEMORY_SIZE - INSTRUCTION_LONG)
+    {
+        // the word would be read past the end of memory, pc stays
+        // where it is so the machine halts on the fault
+        trap         = Trap::MEMORY_OUT_OF_RANGE;
+        trap_address = pc;
+    }
+    else
+    {
+        fetch_opcode();
+
+        // All instructions are 2 bytes long.
+        pc += INSTRUCTION_LONG;
+
+        fetch_instruction_variables();
+        call_opcodes();
+    }
+
+    return executed;
+}
+
+uint64_t Chip8::run(uint64_t instructions) noexcept
+{
+    uint64_t executed = 0;
 
+    pending_idle = Idle::NONE;
+    idle         = Idle::NONE;
+
+    #if ENABLE_PROFILER
+    if(profiler)
+        executed = run_profiled(instructions);
+    else
+    #endif // ENABLE_PROFILER
+    if(tracer)
+        executed = run_traced(instructions);
+    else if(backend == Backend::JIT)
+        executed = jit->run(*this, instructions);
+    else
+        executed = run_interpreted(instructions);
+
+    cycles += executed;
+    return executed;
+}
+
+// The interpreter loop: a plain cached word is executed right here, everything
+// else (fused sequences, words not decoded yet, pc outside the cache) goes through step()
+uint64_t Chip8::run_interpreted(uint64_t instructions) noexcept
+{
+    uint64_t executed = 0;
+
+    // no handler changes these, reading them once keeps them in registers
+    const bool cached = use_decode_cache;
+    const bool fused  = use_fusion;
+
+    while(executed < instructions)
+    {
+        // below the program space the offset wraps around and misses the cache too
+        const uint32_t offset = static_cast<uint16_t>(pc - LOCATION_START);
+        const Decoded_instruction* entry = cached && offset % 2 == 0 && offset / 2 < decode_cache.size()
+                                         ? &decode_cache[offset / 2] : nullptr;
+
+        if(entry && entry->valid && (not fused || entry->fusion == Fusion::NONE))
+        {
+            opcode   = entry->opcode;
+            inst_var = entry->vars;
+            pc += INSTRUCTION_LONG;
+
+            execute(entry->id);
+            executed++;
+        }
+        else
+            executed += step(instructions - executed);
+
+        // every further iteration of the loop leaves the machine as it is now,
+        // only whole iterations are skipped so pc ends where it would have
+        if(pending_idle != Idle::NONE)
+        {
+            const uint64_t length    = pending_idle == Idle::DELAY ? 3 : 1;
+            const uint64_t remaining = instructions - executed;
+
+            executed    += remaining - remaining % length;
+            idle         = pending_idle;
+            pending_idle = Idle::NONE;
+        }
+    }
+
+    return executed;
+}
+
+uint64_t Chip8::run_traced(uint64_t instructions) noexcept
+{
+    for(uint64_t executed = 0; executed < instructions; executed++)
+    {
+        Trace_record record { };
+        record.cycle  = cycles + executed;
+        record.pc     = pc;
+        record.opcode = pc < MEMORY_SIZE - 1 ? memory[pc] << 8 | memory[pc + 1] : 0;
+        record.reg    = Trace_record::NO_REGISTER;
+
+        const auto before = registers;
+        step(1);
+
+        for(size_t i = 0; i < registers.size(); i++)
+        {
+            if(registers[i] != before[i])
+            {
+                record.reg   = static_cast<uint8_t>(i);
+                record.value = registers[i];
+                break;
+            }
+        }
+
+        record.I = I;
+        tracer->record(record);
+    }
+
+    return instructions;
+}
+
+#if ENABLE_PROFILER
+uint64_t Chip8::run_profiled(uint64_t instructions) noexcept
+{
+    using Category = Profiler::Category;
+
+    for(uint64_t executed = 0; executed < instructions; executed++)
+    {
+        const uint16_t  address = pc;
+        const Opcode_id id      = address < MEMORY_SIZE - 1 ? decode(memory[address] << 8 | memory[address + 1]) : ID_ILLEGAL;
+
+        Category category = Category::OTHER;
+        if(id == ID_00E0 || id == ID_DXYN)
+            category = Category::DRAW;
+        else if(id == ID_FX0A)
+            category = Category::KEY_WAIT;
+        else if(id == ID_FX07)
+            category = Category::TIMER_WAIT;
+        else if(poll_chain > 0 && (id == ID_3XKK || id == ID_4XKK || id == ID_1NNN))
+            category = Category::TIMER_WAIT;
+
+        // a poll is FX07, a skip and a jump back
+        poll_chain = id == ID_FX07 ? 2 : category == Category::TIMER_WAIT ? poll_chain - 1 : 0;
+
+        // a budget of 1 never dispatches a fused sequence, every address is counted
+        if(profiler->sample_next())
+        {
+            const uint64_t start = Profiler::ticks();
+            step(1);
+            profiler->record_sample(category, Profiler::ticks() - start);
+        }
+        else
+            step(1);
+
+        profiler->record(address, id, category);
+    }
+
+    return instructions;
+}
+#endif // ENABLE_PROFILER
+
+void Chip8::tick_timers() noexcept
+{
     // decrease delay timer
     if(dt > 0)
         dt--;
 
     if(st > 0)
+        st--;
+
+    publish_sound();
+}
+
+void Chip8::set_sound_flag(std::atomic<bool>* flag) noexcept
+{
+    sound_flag = flag;
+    publish_sound();
+}
+
+namespace
+{
+    constexpr char STATE_MAGIC[4] = { 'C', '8', 'S', 'S' };
+}
+
+void Chip8::save_state(State& state) const noexcept
+{
+    uint8_t* out = state.data();
+
+    for(const uint64_t row : display)   out = put_le(out, row);
+    for(const uint16_t entry : stack)   out = put_le(out, entry);
+
+    out = std::copy(memory.begin(), memory.end(), out);
+
+    for(const uint8_t value : registers) out = put_le(out, value);
+    for(const uint8_t value : keypads)   out = put_le(out, value);
+
+    out = put_le(out, pc);
+    out = put_le(out, I);
+    out = put_le(out, opcode);
+    out = put_le(out, sp);
+    out = put_le(out, dt);
+    out = put_le(out, st);
+    out = put_le(out, rng_state);
+    out = put_le(out, rng_seed);
+    out = put_le(out, cycles);
+    out = put_le(out, static_cast<uint8_t>(trap));
+    out = put_le(out, trap_address);
+
+    // STATE_SIZE lists the same fields
+    assert(out == state.data() + STATE_SIZE);
+}
+
+void Chip8::load_state(const State& state) noexcept
+{
+    const uint8_t* in = state.data();
+
+    for(uint64_t& row : display)   in = get_le(in, row);
+    for(uint16_t& entry : stack)   in = get_le(in, entry);
+
+    std::copy(in, in + memory.size(), memory.begin());
+    in += memory.size();
+
+    for(uint8_t& value : registers) in = get_le(in, value);
+    for(uint8_t& value : keypads)   in = get_le(in, value);
+
+    uint8_t loaded_trap = 0;
+
+    in = get_le(in, pc);
+    in = get_le(in, I);
+    in = get_le(in, opcode);
+    in = get_le(in, sp);
+    in = get_le(in, dt);
+    in = get_le(in, st);
+    in = get_le(in, rng_state);
+    in = get_le(in, rng_seed);
+    in = get_le(in, cycles);
+    in = get_le(in, loaded_trap);
+    in = get_le(in, trap_address);
+
+    trap = static_cast<Trap>(loaded_trap);
+
+    assert(in == state.data() + STATE_SIZE);
+
+    // the program may be a different one now
+    invalidate_code(0, memory.size());
+
+    dirty_rows = 0xFFFFFFFF;
+    display_generation++;
+
+    publish_sound();
+}
+
+void Chip8::save_state(const std::string& path) const
+{
+    std::ofstream file(path, std::ofstream::binary | std::ofstream::out);
+    if(not file.is_open())
+        throw std::invalid_argument("Save state path is invalid!");
+
+    State state;
+    save_state(state);
+
+    uint8_t version[2] { };
+    put_le(version, static_cast<uint16_t>(STATE_VERSION));
+
+    file.write(STATE_MAGIC, sizeof(STATE_MAGIC));
+    file.write(reinterpret_cast<const char*>(version), sizeof(version));
+    file.write(reinterpret_cast<const char*>(state.data()), state.size());
+
+    if(not file)
+        throw std::runtime_error("Could not write the save state!");
+}
+
+void Chip8::load_state(const std::string& path)
+{
+    std::ifstream file(path, std::ifstream::binary | std::ifstream::in);
+    if(not file.is_open())
+        throw std::invalid_argument("Save state path is invalid!");
+
+    char    magic[sizeof(STATE_MAGIC)] { };
+    uint8_t version[2] { };
+    State   state;
+
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(version), sizeof(version));
+
+    if(not file || not std::equal(magic, magic + sizeof(magic), STATE_MAGIC))
+        throw std::runtime_error("File is not a save state!");
+
+    uint16_t saved_version = 0;
+    get_le(version, saved_version);
+
+    if(saved_version != STATE_VERSION)
+        throw std::runtime_error("Save state was made by another version!");
+
+    file.read(reinterpret_cast<char*>(state.data()), state.size());
+    if(file.gcount() != static_cast<std::streamsize>(state.size()))
+        throw std::runtime_error("Save state is truncated!");
+
+    load_state(state);
+}
+
+uint64_t Chip8::state_hash() const noexcept
+{
+    uint64_t hash = 0xCBF29CE484222325;
+
+    auto combine = [&hash](const void* data, size_t size)
     {
-        if(st == 1)
-            std::cout<< "Beep!" << std::endl;
+        const auto* bytes = static_cast<const uint8_t*>(data);
 
-        st--;
+        for(size_t i = 0; i < size; i++)
+        {
+            hash ^= bytes[i];
+            hash *= 0x100000001B3;
+        }
+    };
+
+    combine(display.data(),   sizeof(display));
+    combine(stack.data(),     sizeof(stack));
+    combine(memory.data(),    sizeof(memory));
+    combine(registers.data(), sizeof(registers));
+    combine(keypads.data(),   sizeof(keypads));
+    combine(&pc, sizeof(pc));
+    combine(&I,  sizeof(I));
+    combine(&sp, sizeof(sp));
+    combine(&dt, sizeof(dt));
+    combine(&st, sizeof(st));
+    combine(&rng_state, sizeof(rng_state));
+    combine(&cycles,    sizeof(cycles));
+
+    return hash;
+}
+
+void Chip8::set_backend(Backend new_backend)
+{
+    if(new_backend == Backend::JIT && jit == nullptr)
+    {
+        if(not Jit::is_supported())
+            throw std::runtime_error("JIT backend is not available on this platform!");
+
+        jit = std::make_unique<Jit>();
     }
+
+    backend = new_backend;
+}
+
+Chip8::Opcode_id Chip8::decode(uint16_t opcode) noexcept {
+    return decode_table[opcode];
 }
 
 void Chip8::call_opcodes() noexcept
 {
-    try {
-        // get the first nibble and check what type the opcode is
-        switch(opcode & 0xF000)
-        {
-            case 0x0000: 
-            opcode_table[opcode & 0x000F]();
-            break;
-
-            case 0x1000: case 0x2000: case 0x3000: case 0x4000:
-            case 0x5000: case 0x6000: case 0x7000: case 0xA000:
-            case 0x9000: case 0xB000: case 0xC000: case 0xD000:
-            opcode_table[opcode & 0xF000]();
-            break;
-
-            case 0x8000: case 0xE000: 
-            opcode_table[opcode & 0xF00F]();
-            break;
-
-            case 0xF000:
-            opcode_table[opcode & 0xF0FF]();
-            break;
-        }
-    } 
-    catch(const std::exception& e){};
+    // illegal opcodes land in OPCODE_ILLEGAL_Impl
+    execute(decode(opcode));
 }
 
 
+// Record opcodes that have no implementation and carry on,
+// the program decides for itself whether it is still sane
+void Chip8::OPCODE_ILLEGAL_Impl()
+{
+    raise_trap(Trap::ILLEGAL_OPCODE);
+}
+
+// pc has already moved past the instruction that faulted
+void Chip8::raise_trap(Trap reason) noexcept
+{
+    trap         = reason;
+    trap_address = pc - INSTRUCTION_LONG;
+}
+
 // This is not implemented because i'm not trying to 
 // emulate the RCA 1802 CPU
 // This instruction is only used on the old computers on which Chip-8 was originally implemented. It is ignored by modern interpreters.
 // void Chip8::OPCODE_0NNN_Impl() {}
 
 // Clear the display.
-void Chip8::OPCODE_00E0_Impl() {
+void Chip8::OPCODE_00E0_Impl()
+{
     std::fill(display.begin(), display.end(), 0);
+
+    dirty_rows = 0xFFFFFFFF;
+    display_generation++;
 }
 
 // Return from a subroutine
 void Chip8::OPCODE_00EE_Impl()
 {
+    if(sp == 0)
+    {
+        raise_trap(Trap::STACK_UNDERFLOW);
+        return;
+    }
+
     sp--;
     pc = stack[sp];
 }
 
 // Jump to location nnn
-void Chip8::OPCODE_1NNN_Impl() {
+void Chip8::OPCODE_1NNN_Impl()
+{
+    if(inst_var.nnn + INSTRUCTION_LONG == pc)
+        pending_idle = Idle::JUMP;
+
     pc = inst_var.nnn;
 }  
 
 // Call subroutine at nnn
 void Chip8::OPCODE_2NNN_Impl()
 {
+    if(sp >= STACK_SIZE)
+    {
+        raise_trap(Trap::STACK_OVERFLOW);
+        return;
+    }
+
     stack[sp] = pc;
     sp++;
     pc = inst_var.nnn;
@@ -367,38 +978,48 @@ void Chip8::OPCODE_CXKK_Impl() {
 }
 
 // Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision
+// the starting position wraps around the screen, the sprite itself is clipped at the edges
 void Chip8::OPCODE_DXYN_Impl()
 {
-    registers[REGISTER_SIZE - 1] = 0;
+    const unsigned int x = registers[inst_var.x] % CHIP8_WIDTH;
+    const unsigned int y = registers[inst_var.y] % CHIP8_HEIGHT;
+
+    // rows below the screen and bytes past the end of memory are not drawn
+    const unsigned int rows = std::min<unsigned int>({ inst_var.n, CHIP8_HEIGHT - y, 
+                                                       I < MEMORY_SIZE ? MEMORY_SIZE - I : 0u });
+
+    uint64_t collision  = 0;
+    uint32_t drawn_rows = 0;
 
-    uint8_t x = registers[inst_var.x] % CHIP8_WIDTH;
-	uint8_t y = registers[inst_var.y] % CHIP8_HEIGHT;
+    for(unsigned int row = 0; row < rows; row++)
+    {
+        // the sprite byte starts at the top of the word, shifting it
+        // right by x drops the pixels past the right edge
+        const uint64_t line = (static_cast<uint64_t>(memory[I + row]) << 56) >> x;
 
-    for (unsigned int row = 0; row < inst_var.n; row++)
-	{
-		uint8_t sprite = memory[I + row];
+        collision |= display[y + row] & line;
+        display[y + row] ^= line;
 
-		for (unsigned int col = 0; col < 8; col++)
-		{
-			uint8_t pixel = sprite & (0x80 >> col);
-            uint32_t array_index = (y + row) * CHIP8_WIDTH + (x + col);
+        // a row without any set pixel doesn't change the display
+        if(line != 0)
+            drawn_rows |= 1u << (y + row);
+    }
 
-			if (pixel != 0)
-			{
-				if (display[array_index] == std::numeric_limits<unsigned int>::max()) 
-					registers[0xF] = 1;
+    registers[REGISTER_SIZE - 1] = collision != 0;
 
-				display[array_index] ^= std::numeric_limits<unsigned int>::max();
-			}
-		}
-	}
+    if(drawn_rows != 0)
+    {
+        dirty_rows |= drawn_rows;
+        display_generation++;
+    }
 }
 
 // Skip next instruction if key with the value of Vx is pressed
 void Chip8::OPCODE_EX9E_Impl()
 {
+    // there are no keys past 0xF, they are never pressed
     const uint8_t key = registers[inst_var.x];
-    if(keypads[key])
+    if(key < KEYPADS_SIZE && keypads[key])
         pc += INSTRUCTION_LONG;
 }
 
@@ -406,7 +1027,7 @@ void Chip8::OPCODE_EX9E_Impl()
 void Chip8::OPCODE_EXA1_Impl()
 {
     const uint8_t key = registers[inst_var.x];
-    if(not keypads[key])
+    if(key >= KEYPADS_SIZE || not keypads[key])
         pc += INSTRUCTION_LONG;
 }
 
@@ -429,7 +1050,10 @@ void Chip8::OPCODE_FX0A_Impl()
     }
 
     if(not key_pressed)
+    {
         pc -= INSTRUCTION_LONG;
+        pending_idle = Idle::KEY;
+    }
 }
 
 // Set delay timer = Vx
@@ -440,6 +1064,7 @@ void Chip8::OPCODE_FX15_Impl() {
 // Set sound timer = Vx
 void Chip8::OPCODE_FX18_Impl() {
     st = registers[inst_var.x];
+    publish_sound();
 }
 
 // Set I = I + Vx
@@ -455,6 +1080,12 @@ void Chip8::OPCODE_FX29_Impl() {
 // Store BCD representation of Vx in memory locations I, I+1, and I+2
 void Chip8::OPCODE_FX33_Impl()
 {
+    if(I + 2 >= MEMORY_SIZE)
+    {
+        raise_trap(Trap::MEMORY_OUT_OF_RANGE);
+        return;
+    }
+
     uint8_t value = registers[inst_var.x];
 
     memory[I + 2] = value % 10; 
@@ -464,18 +1095,34 @@ void Chip8::OPCODE_FX33_Impl()
     value /= 10;
 
     memory[I] = value % 10;
+
+    invalidate_code(I, 3);
 }
 
 // Store registers V0 through Vx in memory starting at location I
 void Chip8::OPCODE_FX55_Impl()
 {
+    if(I + inst_var.x >= MEMORY_SIZE)
+    {
+        raise_trap(Trap::MEMORY_OUT_OF_RANGE);
+        return;
+    }
+
     for(uint8_t i = 0; i <= inst_var.x; i++) 
         memory[I + i] = registers[i];
+
+    invalidate_code(I, inst_var.x + 1);
 }
 
 // Read registers V0 through Vx from memory starting at location I
 void Chip8::OPCODE_FX65_Impl()
 {
+    if(I + inst_var.x >= MEMORY_SIZE)
+    {
+        raise_trap(Trap::MEMORY_OUT_OF_RANGE);
+        return;
+    }
+
     for(uint8_t i = 0; i <= inst_var.x; i++)
         registers[i] = memory[I + i];
 }
\ No newline at end of file
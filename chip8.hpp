@@ -2,12 +2,21 @@
 #define CHIP8_HPP
 
 #include <array>
-#include <functional>
-#include <map>
+#include <atomic>
+#include <memory>
+#include <string>
 
 #include "cpu.hpp"
 
-constexpr auto MEMORY_SIZE   = 0xFFF;
+class Jit;
+class Rom_file;
+class Tracer;
+
+#if ENABLE_PROFILER
+class Profiler;
+#endif // ENABLE_PROFILER
+
+constexpr auto MEMORY_SIZE   = 0x1000;
 constexpr auto STACK_SIZE    = 16;
 constexpr auto REGISTER_SIZE = 16;
 constexpr auto KEYPADS_SIZE  = 16;
@@ -22,25 +31,195 @@ class Chip8 : public CPU<STACK_SIZE,
                          CHIP8_HEIGHT> 
 {
 public:
+    // Reasons for the interpreter to stop trusting the program,
+    // recorded instead of throwing from the hot path
+    enum class Trap : uint8_t
+    {
+        NONE,
+        ILLEGAL_OPCODE,
+        STACK_OVERFLOW,      // 2NNN with every stack slot in use
+        STACK_UNDERFLOW,     // 00EE with an empty stack
+        MEMORY_OUT_OF_RANGE, // a fetch, FX33, FX55 or FX65 past the last byte
+        COUNT
+    };
+
+    // Common instruction sequences the interpreter runs with a single dispatch
+    enum class Fusion : uint8_t
+    {
+        NONE,
+        SKIP_EQUAL_JUMP,      // 3XKK, 1NNN
+        SKIP_NOT_EQUAL_JUMP,  // 4XKK, 1NNN
+        LOAD_DRAW,            // ANNN, DXYN
+        COUNT_EQUAL_LOOP,     // 7XKK, 3XKK, 1NNN
+        COUNT_NOT_EQUAL_LOOP, // 7XKK, 4XKK, 1NNN
+        POLL_DELAY_EQUAL,     // FX07, 3XKK, 1NNN
+        POLL_DELAY_NOT_EQUAL, // FX07, 4XKK, 1NNN
+        COUNT
+    };
+
+    // Loops that can't leave before the timers tick or a key changes,
+    // the interpreter skips what's left of run() once it's in one
+    enum class Idle : uint8_t
+    {
+        NONE,
+        JUMP,  // 1NNN to itself
+        KEY,   // FX0A without any key pressed
+        DELAY  // FX07, 3XKK or 4XKK, 1NNN back to the FX07
+    };
+
+    // How instructions are executed by run()
+    enum class Backend : uint8_t
+    {
+        INTERPRETER,
+        JIT
+    };
+
+    enum
+    {
+        LOCATION_START   = 0x200, // where programs are loaded and start executing
+        INSTRUCTION_LONG = 2
+    };
+
+public:
+    // the ROM is copied to LOCATION_START, throws when it doesn't fit in memory
     Chip8(const std::string& file_path);
-    ~Chip8() = default;
+    Chip8(const Rom_file& rom);
+    Chip8(const uint8_t* rom, size_t size);
+
+    // copies the whole machine including the decode cache, the copy
+    // doesn't share the JIT and always starts on the interpreter
+    Chip8(const Chip8& other) noexcept;
+    Chip8(Chip8&& other) noexcept;
+    ~Chip8();
+
+    Chip8& operator=(const Chip8&) = delete;
+    Chip8& operator=(Chip8&&) = delete;
+
+    // a copy of this machine that runs on its own from here
+    Chip8 fork() const noexcept { return Chip8(*this); }
+
+    // the largest ROM that fits between LOCATION_START and the end of memory
+    static constexpr size_t MAX_ROM_SIZE = MEMORY_SIZE - 0x200;
 
     void cycle() noexcept;
 
-private:
-    #if ENABLE_DEBUG_MODE
-    std::string get_memory_as_string(size_t min, size_t max) const noexcept;
-    void clear_terminal() const noexcept;
-    #endif // ENABLE_DEBUG_MODE
+    // execute up to `instructions` instructions with the selected backend,
+    // returns how many were executed
+    uint64_t run(uint64_t instructions) noexcept;
+
+    // the random number generator is part of the machine state,
+    // the same seed and the same input give the same run
+    void seed(uint64_t new_seed) noexcept;
+    constexpr uint64_t get_seed() const noexcept { return rng_seed; }
+
+    // instructions executed through run() so far
+    constexpr uint64_t get_cycles() const noexcept { return cycles; }
+
+    // counts instructions executed outside run(), by code chip8-aot generated
+    void add_cycles(uint64_t count) noexcept { cycles += count; }
+
+    // Size of the serialized machine state: the CPU arrays and registers,
+    // the random number generator, the cycle counter and the trap
+    static constexpr size_t STATE_SIZE =
+        CHIP8_HEIGHT * 8 + STACK_SIZE * 2 + MEMORY_SIZE + REGISTER_SIZE + KEYPADS_SIZE +
+        2 + 2 + 2 + 1 + 1 + 1 + 8 + 8 + 8 + 1 + 2;
+
+    using State = std::array<uint8_t, STATE_SIZE>;
+
+    // a machine that starts exactly where the snapshot was taken
+    explicit Chip8(const State& state) noexcept;
+
+    enum { STATE_VERSION = 2 };
+
+    // the state is little-endian whatever the host is,
+    // loading it drops every cached decode and compiled block
+    void save_state(State& state) const noexcept;
+    void load_state(const State& state) noexcept;
+
+    // "C8SS", uint16 version, then the state, throws when the file can't be
+    // written, isn't a save state or was saved by another version
+    void save_state(const std::string& path) const;
+    void load_state(const std::string& path);
+
+    // decrease the timers once, meant to be called at 60Hz
+    void tick_timers() noexcept;
+
+    // the tone plays while the sound timer is above 0, `flag` follows it so an
+    // audio thread can read it without touching the machine, nullptr stops it,
+    // copies start without a flag
+    void set_sound_flag(std::atomic<bool>* flag) noexcept;
+    constexpr bool is_sound_on() const noexcept { return st > 0; }
+
+    // FNV-1a hash of the whole machine state, equal states give equal hashes
+    uint64_t state_hash() const noexcept;
+
+    // throws when the JIT is not available on this platform
+    void set_backend(Backend new_backend);
+    constexpr Backend get_backend() const noexcept { return backend; }
+
+    // the pre-decoded instruction cache is on by default,
+    // turning it off falls back to decoding every fetched word
+    void set_decode_cache(bool enabled) noexcept;
+    constexpr bool decode_cache_enabled() const noexcept { return use_decode_cache; }
+
+    // fused sequences need the decode cache and are on by default
+    void set_fusion(bool enabled) noexcept;
+    constexpr bool fusion_enabled() const noexcept { return use_fusion; }
+
+    // how many times each fused sequence was dispatched
+    uint64_t get_fusion_count(Fusion fusion) const noexcept;
+    static const char* get_fusion_name(Fusion fusion) noexcept;
+
+    // one bit per display row changed by 00E0 or DXYN since the last
+    // clear_dirty_rows(), bit 0 is the top row
+    constexpr uint32_t get_dirty_rows() const noexcept { return dirty_rows; }
+    constexpr void clear_dirty_rows() noexcept { dirty_rows = 0; }
 
+    // increases every time an instruction changes the display
+    constexpr uint64_t get_display_generation() const noexcept { return display_generation; }
+
+    // the loop the last run() ended in
+    constexpr Idle get_idle() const noexcept { return idle; }
+
+    // nothing changes anymore until a key is pressed or released
+    constexpr bool waits_for_input() const noexcept {
+        return (idle == Idle::JUMP || idle == Idle::KEY) && dt == 0 && st == 0;
+    }
+
+    // the last trap raised by the program and the address it was raised at
+    constexpr Trap get_trap() const noexcept { return trap; }
+    constexpr uint16_t get_trap_address() const noexcept { return trap_address; }
+    static const char* get_trap_name(Trap trap) noexcept;
+
+    // while a tracer is attached run() records every instruction it executes
+    // on the interpreter, nullptr stops tracing, copies start without one
+    void set_tracer(Tracer* new_tracer) noexcept { tracer = new_tracer; }
+    constexpr Tracer* get_tracer() const noexcept { return tracer; }
+
+    #if ENABLE_PROFILER
+    // while a profiler is attached run() takes the interpreter one instruction
+    // at a time, without fusion and whatever the backend, copies start without one
+    void set_profiler(Profiler* new_profiler) noexcept { profiler = new_profiler; }
+    constexpr Profiler* get_profiler() const noexcept { return profiler; }
+    #endif // ENABLE_PROFILER
+
+private:
     void copy_fonts_to_memory() noexcept;
     void fetch_opcode() noexcept;
     void fetch_instruction_variables() noexcept;
     void call_opcodes() noexcept;
-    uint8_t random_byte() const noexcept;
+    uint32_t step(uint64_t budget) noexcept;
+    void invalidate_code(uint16_t address, size_t length) noexcept;
+    uint8_t random_byte() noexcept;
+
+    void publish_sound() noexcept {
+        if(sound_flag)
+            sound_flag->store(st > 0, std::memory_order_relaxed);
+    }
 
     // Opcode implemenations
     // void OPCODE_0NNN_Impl();
+    void OPCODE_ILLEGAL_Impl();
     void OPCODE_00E0_Impl();
     void OPCODE_00EE_Impl();
     void OPCODE_1NNN_Impl();
@@ -77,8 +256,7 @@ private:
     void OPCODE_FX65_Impl();
 
 private:
-    std::map<uint16_t              /*opcode*/, 
-             std::function<void()> /*opcode impl*/> opcode_table;
+    using Opcode_handler = void (Chip8::*)();
 
     // Contains all of the values of the instruction variables 
     // of the current opcode
@@ -91,14 +269,112 @@ private:
         uint8_t kk;
     }; Instruction_variables inst_var;
 
+    // Dense index of every implemented instruction,
+    // the decode table maps each 16-bit opcode to one of these
+    enum Opcode_id : uint8_t
+    {
+        ID_ILLEGAL,
+        ID_00E0, ID_00EE, ID_1NNN, ID_2NNN, ID_3XKK, ID_4XKK, ID_5XY0,
+        ID_6XKK, ID_7XKK, ID_8XY0, ID_8XY1, ID_8XY2, ID_8XY3, ID_8XY4,
+        ID_8XY5, ID_8XY6, ID_8XY7, ID_8XYE, ID_9XY0, ID_ANNN, ID_BNNN,
+        ID_CXKK, ID_DXYN, ID_EX9E, ID_EXA1, ID_FX07, ID_FX0A, ID_FX15,
+        ID_FX18, ID_FX1E, ID_FX29, ID_FX33, ID_FX55, ID_FX65,
+        OPCODE_ID_COUNT
+    };
+
+public:
+    // instruction classes, named like the opcode they decode from
+    static constexpr size_t OPCODE_CLASS_COUNT = OPCODE_ID_COUNT;
+    static const char* get_opcode_name(size_t opcode_class) noexcept;
+    static size_t get_opcode_class(uint16_t opcode) noexcept { return decode(opcode); }
+
+private:
+    static Opcode_id decode(uint16_t opcode) noexcept;
+    static Instruction_variables decode_variables(uint16_t opcode) noexcept;
+    static std::array<Opcode_id, 0x10000> make_decode_table() noexcept;
+
+    // maps every 16-bit opcode to its Opcode_id, shared by all instances
+    static const std::array<Opcode_id, 0x10000> decode_table;
+
+    // run the handler of `id` on the current opcode and inst_var
+    void execute(Opcode_id id) noexcept;
+
+    // the instruction just executed faulted, it is recorded at its own address
+    void raise_trap(Trap reason) noexcept;
+
+    Trap     trap         = Trap::NONE;
+    uint16_t trap_address = 0;
+
+    uint64_t rng_seed  = 0;
+    uint64_t rng_state = 0;
+    uint64_t cycles    = 0;
+
+    static_assert(CHIP8_HEIGHT <= 32, "dirty_rows needs a bit per row");
+
+    // every row starts dirty so the first frame is always drawn
+    uint32_t dirty_rows         = 0xFFFFFFFF;
+    uint64_t display_generation = 0;
+
+    std::atomic<bool>* sound_flag = nullptr;
+
+    // the loop the last instruction completed an iteration of, cleared by run()
+    Idle pending_idle = Idle::NONE;
+    Idle idle         = Idle::NONE;
+
+
+    // A word of the program space decoded once,
+    // reused until FX33 or FX55 writes over it
+    struct Decoded_instruction
+    {
+        Instruction_variables vars;
+        uint16_t  opcode;
+        Opcode_id id;
+        Fusion    fusion; // sequence starting at this word
+        bool      valid;
+    };
+
+    void predecode(size_t cache_index) noexcept;
+    Fusion detect_fusion(size_t cache_index) noexcept;
+
+    // runs the cached words from `cache_index` on as long as
+    // control falls through, returns how many were executed
+    template<Opcode_handler... handlers>
+    uint32_t execute_fused(size_t cache_index) noexcept;
+
+    using Fused_handler = uint32_t (Chip8::*)(size_t);
+    static const std::array<Fused_handler, static_cast<size_t>(Fusion::COUNT)> fused_table;
+    static const std::array<uint8_t, static_cast<size_t>(Fusion::COUNT)> fusion_length;
+
+    // one entry per word between LOCATION_START and the end of memory,
+    // odd addresses are rare enough to always take the slow path
+    std::array<Decoded_instruction, (MEMORY_SIZE - 0x200) / 2> decode_cache { };
+    bool use_decode_cache = true;
+
+    bool use_fusion = true;
+    std::array<uint64_t, static_cast<size_t>(Fusion::COUNT)> fusion_counts { };
+
+    Backend              backend = Backend::INTERPRETER;
+    std::unique_ptr<Jit> jit;
+
+    uint64_t run_interpreted(uint64_t instructions) noexcept;
+    uint64_t run_traced(uint64_t instructions) noexcept;
+
+    Tracer* tracer = nullptr;
+
+    #if ENABLE_PROFILER
+    uint64_t run_profiled(uint64_t instructions) noexcept;
+
+    Profiler* profiler = nullptr;
+
+    // instructions left of a delay timer poll after its FX07
+    uint8_t poll_chain = 0;
+    #endif // ENABLE_PROFILER
+
 
 private:
     // Constants
     enum 
     {
-        LOCATION_START   = 0x200,
-        INSTRUCTION_LONG = 2,
-
         // static constexpr auto OPCODE_0NNN = 0x0000; // Jump to a machine code routine at nnn
         OPCODE_00E0 = 0x0000, // Clear the display
         OPCODE_00EE = 0x000E, // Return from a subroutine
@@ -12,20 +12,23 @@ template<size_t STACK,
          size_t HEIGHT>
 struct CPU
 {
-    std::array<uint32_t, WIDTH * HEIGHT>   display   { 0 };
+    static_assert(WIDTH <= 64, "every display row is packed in one 64-bit word");
+
+    // one word per row, the most significant bit is the leftmost pixel
+    std::array<uint64_t, HEIGHT>           display   { 0 };
     std::array<uint16_t, STACK>            stack     { 0 };
     std::array<uint8_t,  MEMORY>           memory    { 0 };
     std::array<uint8_t,  REGISTER>         registers { 0 };
     std::array<uint8_t,  KEYS>             keypads   { 0 };
 
-    uint16_t pc;     // used to store the currently executing address
-    uint16_t I;      // this register is generally used to store memory addresses
-    uint16_t opcode; // the current operation code
-    uint8_t  sp;     // used to point to the topmost level of the stack
+    uint16_t pc     = 0; // used to store the currently executing address
+    uint16_t I      = 0; // this register is generally used to store memory addresses
+    uint16_t opcode = 0; // the current operation code
+    uint8_t  sp     = 0; // used to point to the topmost level of the stack
 
     // these are automatically decremented at a rate of 60Hz.
-    uint8_t  dt;     // delay of the program
-    uint8_t  st;   // delay of the sounds
+    uint8_t  dt     = 0; // delay of the program
+    uint8_t  st     = 0; // delay of the sounds
 };
 
 #endif // CPU_HPP
\ No newline at end of file
@@ -0,0 +1,152 @@
+#include "environment.hpp"
+
+#include <exception>
+#include <stdexcept>
+
+Environment_pool::Environment_pool(const Chip8& machine, size_t count, Observation observation, uint64_t clock)
+    : count(count),
+      observation(observation),
+      observation_size(observation_bytes(observation)),
+      clock(clock)
+{
+    if(count == 0)
+        throw std::invalid_argument("Environment pool needs at least one environment!");
+
+    machine.save_state(initial);
+
+    machines.reserve(count);
+    schedulers.reserve(count);
+    for(size_t env = 0; env < count; env++)
+    {
+        machines.emplace_back(machine);
+        schedulers.emplace_back(clock, true);
+    }
+
+    rewards.resize(count);
+    dones.resize(count);
+    observations.resize(count * observation_size / sizeof(uint64_t));
+
+    reset(machine.get_seed());
+}
+
+void Environment_pool::reset(uint64_t seed) noexcept
+{
+    for(size_t env = 0; env < count; env++)
+        reset(env, seed + env);
+}
+
+void Environment_pool::reset(size_t env, uint64_t seed) noexcept
+{
+    Chip8& chip = machines[env];
+
+    // loading a state marks every row dirty, the whole observation is rewritten
+    chip.load_state(initial);
+    chip.seed(seed);
+    schedulers[env] = Scheduler(clock, true);
+
+    rewards[env] = 0;
+    dones[env]   = 0;
+    observe(env);
+}
+
+void Environment_pool::step(const uint16_t* key_masks, uint32_t frames) noexcept
+{
+    for(size_t env = 0; env < count; env++)
+    {
+        rewards[env] = 0;
+        if(dones[env])
+            continue;
+
+        Chip8& chip = machines[env];
+        for(size_t key = 0; key < chip.keypads.size(); key++)
+            chip.keypads[key] = key_masks[env] >> key & 1;
+
+        for(uint32_t frame = 0; frame < frames; frame++)
+        {
+            schedulers[env].run_frame(chip);
+
+            if(reward_hook)
+                rewards[env] += reward_hook(env, chip, reward_context);
+
+            const bool done = done_hook ? done_hook(env, chip, done_context)
+                                        : chip.get_trap() != Chip8::Trap::NONE;
+            if(done)
+            {
+                dones[env] = 1;
+                break;
+            }
+        }
+
+        observe(env);
+    }
+}
+
+void Environment_pool::set_reward_hook(Reward_hook hook, void* context) noexcept
+{
+    reward_hook    = hook;
+    reward_context = context;
+}
+
+void Environment_pool::set_done_hook(Done_hook hook, void* context) noexcept
+{
+    done_hook    = hook;
+    done_context = context;
+}
+
+void Environment_pool::observe(size_t env) noexcept
+{
+    Chip8& chip = machines[env];
+    const uint32_t dirty = chip.get_dirty_rows();
+    if(dirty == 0)
+        return;
+
+    chip.clear_dirty_rows();
+
+    uint8_t* out = reinterpret_cast<uint8_t*>(observations.data()) + env * observation_size;
+
+    switch(observation)
+    {
+    case Observation::PACKED:
+    {
+        uint64_t* rows = reinterpret_cast<uint64_t*>(out);
+        for(size_t y = 0; y < CHIP8_HEIGHT; y++)
+        {
+            if(dirty >> y & 1)
+                rows[y] = chip.display[y];
+        }
+        break;
+    }
+
+    case Observation::PIXELS:
+        for(size_t y = 0; y < CHIP8_HEIGHT; y++)
+        {
+            if(not (dirty >> y & 1))
+                continue;
+
+            const uint64_t row = chip.display[y];
+            for(size_t x = 0; x < CHIP8_WIDTH; x++)
+                out[y * CHIP8_WIDTH + x] = row >> (63 - x) & 1;
+        }
+        break;
+
+    case Observation::DOWNSAMPLED:
+        for(size_t y = 0; y < CHIP8_HEIGHT; y += 2)
+        {
+            if(not (dirty >> y & 3))
+                continue;
+
+            const uint64_t top    = chip.display[y];
+            const uint64_t bottom = chip.display[y + 1];
+            for(size_t x = 0; x < CHIP8_WIDTH; x += 2)
+            {
+                // the two pixels of the block in each row, leftmost in the high bit
+                const unsigned shift = 62 - x;
+                const unsigned lit   = (top >> shift & 1) + (top >> (shift + 1) & 1) +
+                                       (bottom >> shift & 1) + (bottom >> (shift + 1) & 1);
+
+                out[y / 2 * (CHIP8_WIDTH / 2) + x / 2] = static_cast<uint8_t>(lit);
+            }
+        }
+        break;
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef ENVIRONMENT_HPP
+#define ENVIRONMENT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "chip8.hpp"
+#include "scheduler.hpp"
+
+// A batch of machines driven by an agent, every step presses the keys of a mask,
+// runs a few frames and leaves the reward, the done flag and the screen of every
+// environment in buffers allocated once by the constructor
+class Environment_pool
+{
+public:
+    // How the screen of an environment is laid out in the observation buffer
+    enum class Observation : uint8_t
+    {
+        PACKED,     // one uint64_t per row, bit 63 is the leftmost pixel
+        PIXELS,     // one byte per pixel, 0 or 1
+        DOWNSAMPLED // one byte per 2x2 block, how many of its pixels are lit
+    };
+
+    // called after every frame, `context` is passed through untouched
+    using Reward_hook = float (*)(size_t env, const Chip8& chip, void* context);
+    using Done_hook   = bool  (*)(size_t env, const Chip8& chip, void* context);
+
+    // every environment restarts from `machine`, throws when count or clock is 0
+    Environment_pool(const Chip8& machine, size_t count,
+                     Observation observation = Observation::PACKED,
+                     uint64_t clock = Scheduler::DEFAULT_CLOCK);
+
+    // restart every environment, environment i is seeded with seed + i
+    void reset(uint64_t seed) noexcept;
+    void reset(size_t env, uint64_t seed) noexcept;
+
+    // hold the keys of key_masks[env] (bit k is key k) and run `frames` frames
+    // on every environment that isn't done, the reward is summed over the frames
+    // and an environment stops at the frame it's done
+    void step(const uint16_t* key_masks, uint32_t frames) noexcept;
+
+    // without a reward hook the reward is always 0, without a done hook
+    // an environment is done when its program hits an illegal opcode
+    void set_reward_hook(Reward_hook hook, void* context = nullptr) noexcept;
+    void set_done_hook(Done_hook hook, void* context = nullptr) noexcept;
+
+    // the buffers hold one entry per environment and stay at the same address
+    const float*   get_rewards() const noexcept { return rewards.data(); }
+    const uint8_t* get_dones() const noexcept { return dones.data(); }
+
+    // observations are get_observation_size() bytes apart, each one starts 8-byte aligned
+    const uint8_t* get_observations() const noexcept { return reinterpret_cast<const uint8_t*>(observations.data()); }
+    const uint8_t* get_observation(size_t env) const noexcept { return get_observations() + env * observation_size; }
+    constexpr size_t get_observation_size() const noexcept { return observation_size; }
+    constexpr Observation get_observation_type() const noexcept { return observation; }
+
+    static constexpr size_t observation_bytes(Observation observation) noexcept
+    {
+        return observation == Observation::PACKED ? CHIP8_HEIGHT * sizeof(uint64_t) :
+               observation == Observation::PIXELS ? CHIP8_WIDTH * CHIP8_HEIGHT :
+                                                    CHIP8_WIDTH / 2 * CHIP8_HEIGHT / 2;
+    }
+
+    const Chip8& get_machine(size_t env) const noexcept { return machines[env]; }
+    constexpr size_t size() const noexcept { return count; }
+
+private:
+    static_assert(CHIP8_WIDTH == 64, "packed rows hold the whole width");
+    static_assert(CHIP8_HEIGHT % 2 == 0, "2x2 blocks need an even height");
+
+    // rewrite the rows of the observation the machine drew over since the last step
+    void observe(size_t env) noexcept;
+
+    size_t      count;
+    Observation observation;
+    size_t      observation_size;
+    uint64_t    clock;
+
+    // every reset loads this instead of copying a whole machine
+    Chip8::State initial { };
+
+    std::vector<Chip8>     machines;
+    std::vector<Scheduler> schedulers;
+
+    std::vector<float>    rewards;
+    std::vector<uint8_t>  dones;
+    std::vector<uint64_t> observations;
+
+    Reward_hook reward_hook    = nullptr;
+    void*       reward_context = nullptr;
+    Done_hook   done_hook      = nullptr;
+    void*       done_context   = nullptr;
+};
+
+#endif // ENVIRONMENT_HPP
@@ -0,0 +1,126 @@
+#include "framebuffer.hpp"
+
+#include <exception>
+#include <stdexcept>
+
+#if CHIP8_SIMD_SUPPORTED
+#include <immintrin.h>
+#endif // CHIP8_SIMD_SUPPORTED
+
+Framebuffer::Framebuffer(uint32_t on_color, uint32_t off_color) noexcept
+    : on_color(on_color), off_color(off_color)
+{
+    if(is_supported(Expansion::AVX2))
+        expansion = Expansion::AVX2;
+    else if(is_supported(Expansion::SSE2))
+        expansion = Expansion::SSE2;
+
+    pixels.fill(off_color);
+}
+
+bool Framebuffer::is_supported(Expansion expansion) noexcept
+{
+    switch(expansion)
+    {
+        case Expansion::SCALAR: return true;
+
+        #if CHIP8_SIMD_SUPPORTED
+        // SSE2 is part of x86-64, AVX2 has to be asked for
+        case Expansion::SSE2: return CHIP8_WIDTH == 64;
+        case Expansion::AVX2: return CHIP8_WIDTH == 64 && __builtin_cpu_supports("avx2");
+        #endif // CHIP8_SIMD_SUPPORTED
+
+        default: return false;
+    }
+}
+
+const char* Framebuffer::get_expansion_name(Expansion expansion) noexcept
+{
+    switch(expansion)
+    {
+        case Expansion::SCALAR: return "scalar";
+        case Expansion::SSE2:   return "sse2";
+        case Expansion::AVX2:   return "avx2";
+    }
+
+    return "unknown";
+}
+
+void Framebuffer::set_expansion(Expansion new_expansion)
+{
+    if(not is_supported(new_expansion))
+        throw std::runtime_error("Pixel expansion is not available on this host!");
+
+    expansion = new_expansion;
+}
+
+void Framebuffer::expand_rows(const Packed_display& display, uint32_t rows) noexcept
+{
+    for(size_t y = 0; y < display.size(); y++)
+    {
+        if((rows >> y & 1) == 0)
+            continue;
+
+        uint32_t* out = pixels.data() + y * CHIP8_WIDTH;
+
+        switch(expansion)
+        {
+            case Expansion::AVX2: expand_row_avx2(display[y], out); break;
+            case Expansion::SSE2: expand_row_sse2(display[y], out); break;
+            default:              expand_row_scalar(display[y], out); break;
+        }
+    }
+}
+
+void Framebuffer::expand_row_scalar(uint64_t row, uint32_t* out) const noexcept
+{
+    for(size_t x = 0; x < CHIP8_WIDTH; x++)
+        out[x] = (row >> (63 - x) & 1) ? on_color : off_color;
+}
+
+#if CHIP8_SIMD_SUPPORTED
+// 4 pixels per vector, every lane tests its own bit of the nibble
+void Framebuffer::expand_row_sse2(uint64_t row, uint32_t* out) const noexcept
+{
+    const __m128i bits = _mm_set_epi32(1, 2, 4, 8);
+    const __m128i on   = _mm_set1_epi32(static_cast<int>(on_color));
+    const __m128i off  = _mm_set1_epi32(static_cast<int>(off_color));
+
+    for(int group = 0; group < 16; group++)
+    {
+        const auto nibble = static_cast<int>(row >> (60 - group * 4) & 0xF);
+
+        const __m128i set  = _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(nibble), bits), bits);
+        const __m128i rgba = _mm_or_si128(_mm_and_si128(set, on), _mm_andnot_si128(set, off));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + group * 4), rgba);
+    }
+}
+
+// 8 pixels per vector, one byte of the row at a time
+__attribute__((target("avx2")))
+void Framebuffer::expand_row_avx2(uint64_t row, uint32_t* out) const noexcept
+{
+    const __m256i bits = _mm256_set_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    const __m256i on   = _mm256_set1_epi32(static_cast<int>(on_color));
+    const __m256i off  = _mm256_set1_epi32(static_cast<int>(off_color));
+
+    for(int group = 0; group < 8; group++)
+    {
+        const auto byte = static_cast<int>(row >> (56 - group * 8) & 0xFF);
+
+        const __m256i set  = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(byte), bits), bits);
+        const __m256i rgba = _mm256_blendv_epi8(off, on, set);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + group * 8), rgba);
+    }
+}
+#else
+void Framebuffer::expand_row_sse2(uint64_t row, uint32_t* out) const noexcept {
+    expand_row_scalar(row, out);
+}
+
+void Framebuffer::expand_row_avx2(uint64_t row, uint32_t* out) const noexcept {
+    expand_row_scalar(row, out);
+}
+#endif // CHIP8_SIMD_SUPPORTED
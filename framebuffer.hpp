@@ -0,0 +1,60 @@
+#ifndef FRAMEBUFFER_HPP
+#define FRAMEBUFFER_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "chip8.hpp"
+
+// the vector expansions use x86 intrinsics, everything else uses the scalar loop
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CHIP8_SIMD_SUPPORTED 1
+#else
+#define CHIP8_SIMD_SUPPORTED 0
+#endif
+
+// Expands the packed display into one 32-bit pixel per Chip8 pixel,
+// only done when a frame is presented
+class Framebuffer
+{
+public:
+    // Which implementation expand_rows() uses
+    enum class Expansion : uint8_t
+    {
+        SCALAR,
+        SSE2,
+        AVX2
+    };
+
+    using Packed_display = decltype(Chip8::display);
+    using Pixels         = std::array<uint32_t, CHIP8_WIDTH * CHIP8_HEIGHT>;
+
+    // colors are RGBA8888, picks the fastest expansion the host supports
+    Framebuffer(uint32_t on_color = 0xFFFFFFFF, uint32_t off_color = 0x00000000) noexcept;
+
+    // expand every row set in `rows`, bit 0 is the top row
+    void expand_rows(const Packed_display& display, uint32_t rows) noexcept;
+
+    // throws when the host doesn't support the expansion
+    void set_expansion(Expansion new_expansion);
+    constexpr Expansion get_expansion() const noexcept { return expansion; }
+
+    static bool is_supported(Expansion expansion) noexcept;
+    static const char* get_expansion_name(Expansion expansion) noexcept;
+
+    constexpr const Pixels& get_pixels() const noexcept { return pixels; }
+
+private:
+    void expand_row_scalar(uint64_t row, uint32_t* out) const noexcept;
+    void expand_row_sse2(uint64_t row, uint32_t* out) const noexcept;
+    void expand_row_avx2(uint64_t row, uint32_t* out) const noexcept;
+
+    uint32_t  on_color;
+    uint32_t  off_color;
+    Expansion expansion = Expansion::SCALAR;
+
+    Pixels pixels { };
+};
+
+#endif // FRAMEBUFFER_HPP
@@ -0,0 +1,97 @@
+#include "headless.hpp"
+
+#include <chrono>
+#include <iomanip>
+
+Headless_result run_headless(Chip8& chip, const Headless_options& options, Input_replay* replay, Wav_sink* audio, Capture* capture)
+{
+    Headless_result result;
+    Scheduler scheduler(options.clock, true);
+    const auto start = std::chrono::steady_clock::now();
+
+    if(options.frames > 0)
+    {
+        while(scheduler.get_frames() < options.frames)
+        {
+            if(replay)
+                replay->apply(chip);
+
+            result.instructions += scheduler.run_frame(chip);
+
+            if(audio)
+                audio->on_frame(chip.is_sound_on());
+            if(capture)
+                capture->on_frame(chip);
+        }
+    }
+    else
+    {
+        // the last frame may be cut short by the instruction budget
+        while(result.instructions < options.instructions)
+        {
+            if(replay)
+                replay->apply(chip);
+
+            const uint64_t frames = scheduler.get_frames();
+            result.instructions += scheduler.run_frame(chip, options.instructions - result.instructions);
+
+            if(scheduler.get_frames() == frames)
+                continue;
+
+            if(audio)
+                audio->on_frame(chip.is_sound_on());
+            if(capture)
+                capture->on_frame(chip);
+        }
+    }
+
+    result.frames = scheduler.get_frames();
+
+    const auto end = std::chrono::steady_clock::now();
+    result.seconds = std::chrono::duration<double>(end - start).count();
+
+    return result;
+}
+
+void print_state(std::ostream& out, const Chip8& chip, const Headless_result& result)
+{
+    out << std::hex << std::setfill('0');
+
+    out << "pc: 0x" << std::setw(3) << chip.pc
+        << " I: 0x" << std::setw(3) << chip.I
+        << " sp: " << std::dec << +chip.sp
+        << " dt: " << +chip.dt
+        << " st: " << +chip.st << "\n";
+
+    out << std::hex;
+    for(size_t i = 0; i < chip.registers.size(); i++)
+        out << "V" << i << ": " << std::setw(2) << +chip.registers[i] << (i % 8 == 7 ? "\n" : " ");
+
+    out << "state hash: " << std::setw(16) << chip.state_hash() << "\n";
+    out << "seed: " << std::dec << chip.get_seed() << " cycles: " << chip.get_cycles() << std::hex << "\n";
+    out << "display generation: " << std::dec << chip.get_display_generation() << std::hex << "\n";
+
+    if(chip.get_trap() != Chip8::Trap::NONE)
+        out << "trap: " << Chip8::get_trap_name(chip.get_trap())
+            << " at 0x" << std::setw(3) << chip.get_trap_address() << "\n";
+
+    out << std::dec << std::setfill(' ');
+
+    for(size_t i = 1; i < static_cast<size_t>(Chip8::Fusion::COUNT); i++)
+    {
+        const auto fusion = static_cast<Chip8::Fusion>(i);
+
+        if(chip.get_fusion_count(fusion) > 0)
+            out << "fused " << Chip8::get_fusion_name(fusion) << ": " << chip.get_fusion_count(fusion) << "\n";
+    }
+
+    out << "instructions: " << result.instructions;
+    if(result.frames > 0)
+        out << " frames: " << result.frames;
+    out << "\n";
+
+    const double per_second = result.seconds > 0 ? result.instructions / result.seconds : 0;
+    out << "time: " << std::fixed << std::setprecision(3) << result.seconds * 1000 << " ms, "
+        << std::setprecision(1) << per_second / 1e6 << " M instructions/s\n";
+    out << std::defaultfloat;
+}
@@ -0,0 +1,39 @@
+#ifndef HEADLESS_HPP
+#define HEADLESS_HPP
+
+#include <cstdint>
+#include <ostream>
+
+#include "chip8.hpp"
+#include "scheduler.hpp"
+#include "replay.hpp"
+#include "audio.hpp"
+#include "capture.hpp"
+
+// How long a headless run lasts, whichever budget is set
+struct Headless_options
+{
+    uint64_t instructions = 0;
+    uint64_t frames       = 0;
+
+    // instructions per emulated second, the timers tick every sixtieth of it
+    uint64_t clock = Scheduler::DEFAULT_CLOCK;
+};
+
+struct Headless_result
+{
+    uint64_t instructions = 0;
+    uint64_t frames       = 0;
+    double   seconds      = 0;
+};
+
+// Run the emulator without any window as fast as possible, the keypad follows
+// `replay` when there is one and every finished frame goes to `audio` and `capture`,
+// throws when the clock is 0
+Headless_result run_headless(Chip8& chip, const Headless_options& options, Input_replay* replay = nullptr,
+                             Wav_sink* audio = nullptr, Capture* capture = nullptr);
+
+// Print the final machine state and the throughput of a run
+void print_state(std::ostream& out, const Chip8& chip, const Headless_result& result);
+
+#endif // HEADLESS_HPP
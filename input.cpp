@@ -0,0 +1,150 @@
+#include "input.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+
+namespace
+{
+    struct Key_name
+    {
+        std::string_view name;
+        uint16_t         scancode;
+    };
+
+    // the keys a keymap can name besides letters and digits
+    constexpr Key_name KEY_NAMES[] {
+        { "return", 40 }, { "escape", 41 }, { "backspace", 42 }, { "tab", 43 }, { "space", 44 },
+        { "-", 45 }, { "=", 46 }, { "[", 47 }, { "]", 48 }, { "\\", 49 }, { ";", 51 }, { "'", 52 },
+        { "`", 53 }, { ",", 54 }, { ".", 55 }, { "/", 56 },
+        { "right", 79 }, { "left", 80 }, { "down", 81 }, { "up", 82 },
+        { "f1", 58 }, { "f2", 59 }, { "f3", 60 }, { "f4", 61 }, { "f5", 62 }, { "f6", 63 },
+        { "f7", 64 }, { "f8", 65 }, { "f9", 66 }, { "f10", 67 }, { "f11", 68 }, { "f12", 69 },
+        { "kp1", 89 }, { "kp2", 90 }, { "kp3", 91 }, { "kp4", 92 }, { "kp5", 93 },
+        { "kp6", 94 }, { "kp7", 95 }, { "kp8", 96 }, { "kp9", 97 }, { "kp0", 98 }
+    };
+}
+
+int Keymap::get_scancode(const std::string& name) noexcept
+{
+    if(name.size() == 1 && name[0] >= 'a' && name[0] <= 'z')
+        return 4 + (name[0] - 'a');
+
+    // 1 to 9 come before 0
+    if(name.size() == 1 && name[0] >= '1' && name[0] <= '9')
+        return 30 + (name[0] - '1');
+    if(name == "0")
+        return 39;
+
+    for(const Key_name& key : KEY_NAMES)
+    {
+        if(key.name == name)
+            return key.scancode;
+    }
+
+    return -1;
+}
+
+Keymap::Keymap()
+{
+    table.fill(NO_KEY);
+
+    static constexpr std::array<const char*, 16> defaults {
+        "x", "1", "2", "3", "q", "w", "e", "a", "s", "d", "z", "c", "4", "r", "f", "v"
+    };
+
+    for(size_t key = 0; key < defaults.size(); key++)
+        map(defaults[key], static_cast<uint8_t>(key));
+}
+
+Keymap::Keymap(std::istream& in)
+{
+    table.fill(NO_KEY);
+
+    std::string line;
+    for(size_t number = 1; std::getline(in, line); number++)
+    {
+        line = line.substr(0, line.find('#'));
+        std::transform(line.begin(), line.end(), line.begin(), [](unsigned char c) { return std::tolower(c); });
+
+        std::istringstream words(line);
+        std::string key, name, rest;
+        if(not (words >> key))
+            continue;
+
+        const bool valid = key.size() == 1 && std::isxdigit(static_cast<unsigned char>(key[0])) &&
+                           (words >> name) && not (words >> rest) &&
+                           map(name, static_cast<uint8_t>(std::stoi(key, nullptr, 16)));
+        if(not valid)
+            throw std::invalid_argument("Keymap line " + std::to_string(number) + " is invalid!");
+    }
+}
+
+Keymap::Keymap(const std::string& path)
+{
+    std::ifstream file(path);
+    if(not file.is_open())
+        throw std::invalid_argument("Keymap path is invalid!");
+
+    *this = Keymap(file);
+}
+
+bool Keymap::map(const std::string& name, uint8_t key) noexcept
+{
+    const int scancode = get_scancode(name);
+    if(scancode < 0 || key >= KEYPADS_SIZE)
+        return false;
+
+    table[scancode] = key;
+    return true;
+}
+
+bool Input_queue::push(uint8_t key, bool pressed) noexcept
+{
+    if(key >= KEYPADS_SIZE)
+        return false;
+
+    // the cycle is only known once the machine applies it
+    return events.try_push({ 0, key, static_cast<uint8_t>(pressed) });
+}
+
+size_t Input_queue::drain(Chip8& chip, Input_recorder* recorder)
+{
+    uint16_t changed = 0;
+    size_t   count   = 0;
+
+    Input_event event;
+    while(has_deferred || events.pop(&event, 1) == 1)
+    {
+        if(has_deferred)
+        {
+            event        = deferred;
+            has_deferred = false;
+        }
+
+        // the second change of a key in one frame would undo the first
+        if(changed >> event.key & 1)
+        {
+            deferred     = event;
+            has_deferred = true;
+            break;
+        }
+
+        if((chip.keypads[event.key] != 0) == (event.pressed != 0))
+            continue;
+
+        chip.keypads[event.key] = event.pressed;
+        changed |= static_cast<uint16_t>(1u << event.key);
+        count++;
+
+        event.cycle = chip.get_cycles();
+        if(recorder)
+            recorder->record(event);
+    }
+
+    return count;
+}
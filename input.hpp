@@ -0,0 +1,75 @@
+#ifndef INPUT_HPP
+#define INPUT_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+
+#include "chip8.hpp"
+#include "replay.hpp"
+#include "spsc_queue.hpp"
+
+// Host scancode to keypad lookup. Scancodes are USB HID usage ids,
+// the same numbers SDL uses, so the core doesn't need SDL to read a keymap.
+class Keymap
+{
+public:
+    enum
+    {
+        SCANCODE_COUNT = 512,
+        NO_KEY         = 0xFF
+    };
+
+    // 1 2 3 4 / Q W E R / A S D F / Z X C V
+    Keymap();
+
+    // One mapping per line, "<keypad digit> <host key>" like "A z" or "5 up",
+    // '#' starts a comment, unmapped keys do nothing. Throws on a line that
+    // doesn't parse and when the file can't be read.
+    explicit Keymap(std::istream& in);
+    explicit Keymap(const std::string& path);
+
+    // the keypad index or NO_KEY
+    constexpr uint8_t lookup(int scancode) const noexcept {
+        return scancode >= 0 && scancode < SCANCODE_COUNT ? table[scancode] : static_cast<uint8_t>(NO_KEY);
+    }
+
+    // returns false when `name` isn't a known key
+    bool map(const std::string& name, uint8_t key) noexcept;
+
+    // the scancode of a lowercase key name like "a", "7" or "up", -1 when there's none
+    static int get_scancode(const std::string& name) noexcept;
+
+private:
+    std::array<uint8_t, SCANCODE_COUNT> table;
+};
+
+// Key transitions from the frontend to the machine. The frontend pushes them
+// whenever it polls, the emulation applies them at the start of a frame, so
+// when a key changes depends only on the frame it arrived in.
+class Input_queue
+{
+public:
+    // producer: returns false when the queue is full and the event is lost,
+    // or when `key` isn't a keypad key
+    bool push(uint8_t key, bool pressed) noexcept;
+
+    // consumer: apply the waiting transitions to `chip` in order, stamped with its cycle.
+    // The second change of a key in one call and everything after it wait for the
+    // next call, so a tap shorter than a frame is still seen by the program.
+    // Returns how many keys changed.
+    size_t drain(Chip8& chip, Input_recorder* recorder = nullptr);
+
+private:
+    enum { CAPACITY = 256 };
+
+    Spsc_queue<Input_event, CAPACITY> events;
+
+    // consumer side, the first event of the next drain
+    Input_event deferred { };
+    bool        has_deferred = false;
+};
+
+#endif // INPUT_HPP
@@ -0,0 +1,485 @@
+#include "jit.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+
+#if CHIP8_JIT_SUPPORTED
+#include <sys/mman.h>
+#endif // CHIP8_JIT_SUPPORTED
+
+namespace
+{
+    using Chip8_cpu = CPU<STACK_SIZE,
+                          MEMORY_SIZE,
+                          REGISTER_SIZE,
+                          KEYPADS_SIZE,
+                          CHIP8_WIDTH,
+                          CHIP8_HEIGHT>;
+
+    // where the compiled code finds the CPU state, relative to rdi
+    constexpr uint32_t OFFSET_STACK     = offsetof(Chip8_cpu, stack);
+    constexpr uint32_t OFFSET_REGISTERS = offsetof(Chip8_cpu, registers);
+    constexpr uint32_t OFFSET_PC        = offsetof(Chip8_cpu, pc);
+    constexpr uint32_t OFFSET_I         = offsetof(Chip8_cpu, I);
+    constexpr uint32_t OFFSET_SP        = offsetof(Chip8_cpu, sp);
+
+    constexpr uint32_t register_offset(uint8_t index) noexcept {
+        return OFFSET_REGISTERS + index;
+    }
+
+    constexpr uint32_t OFFSET_VF = OFFSET_REGISTERS + REGISTER_SIZE - 1;
+
+    // x86 registers used as the reg field of ModRM
+    constexpr uint8_t AL = 0;
+    constexpr uint8_t CL = 1;
+}
+
+Jit::Jit()
+{
+    #if CHIP8_JIT_SUPPORTED
+    // writable until the first block is compiled, never writable and executable at once
+    void* buffer = mmap(nullptr, CODE_BUFFER_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if(buffer == MAP_FAILED)
+        throw std::runtime_error("Could not allocate executable memory for the JIT!");
+
+    code = static_cast<uint8_t*>(buffer);
+    #else
+    throw std::runtime_error("JIT backend is not available on this platform!");
+    #endif // CHIP8_JIT_SUPPORTED
+}
+
+Jit::~Jit()
+{
+    #if CHIP8_JIT_SUPPORTED
+    munmap(code, CODE_BUFFER_SIZE);
+    code = nullptr;
+    #endif // CHIP8_JIT_SUPPORTED
+}
+
+uint64_t Jit::run(Chip8& chip, uint64_t instructions) noexcept
+{
+    Chip8_cpu* cpu = &chip;
+    uint64_t executed = 0;
+
+    while(executed < instructions)
+    {
+        const uint64_t remaining = instructions - executed;
+
+        // a block may execute up to MAX_BLOCK_INSTRUCTIONS before it checks the budget
+        Block_function block = remaining >= MAX_BLOCK_INSTRUCTIONS ? lookup(chip, chip.pc) : nullptr;
+
+        if(block != nullptr)
+        {
+            int64_t budget = static_cast<int64_t>(remaining);
+            block(cpu, &budget);
+
+            const uint64_t done = remaining - static_cast<uint64_t>(budget);
+            executed += done;
+
+            // the block bailed before its first instruction,
+            // the interpreter executes it and raises the trap
+            if(done == 0)
+            {
+                chip.cycle();
+                executed++;
+            }
+        }
+        else
+        {
+            // FX33 and FX55 may invalidate blocks from inside cycle()
+            chip.cycle();
+            executed++;
+        }
+    }
+
+    return executed;
+}
+
+void Jit::invalidate(uint16_t address, size_t length) noexcept
+{
+    for(size_t i = address; i < address + length && i < translated.size(); i++)
+    {
+        // self-modifying code is rare, so just start over
+        if(translated[i])
+        {
+            flush();
+            return;
+        }
+    }
+}
+
+Jit::Block_function Jit::lookup(const Chip8& chip, uint16_t address) noexcept
+{
+    // the whole instruction has to be inside the memory
+    if(address + 1 >= MEMORY_SIZE)
+        return nullptr;
+
+    Block& block = blocks[address];
+
+    if(block.state == Block_state::UNCOMPILED)
+    {
+        // compiling may also patch the exits of older blocks
+        if(not set_writable(true))
+            return nullptr;
+
+        block = compile(chip, address);
+
+        // no block may run from a buffer that isn't executable, start over next time
+        if(not set_writable(false))
+        {
+            flush();
+            return nullptr;
+        }
+    }
+
+    return block.function;
+}
+
+// switch the whole code buffer between read/write and read/execute
+bool Jit::set_writable(bool enable) noexcept
+{
+    if(writable == enable)
+        return true;
+
+    #if CHIP8_JIT_SUPPORTED
+    const int protection = enable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC;
+    if(mprotect(code, CODE_BUFFER_SIZE, protection) != 0)
+        return false;
+    #endif // CHIP8_JIT_SUPPORTED
+
+    writable = enable;
+    return true;
+}
+
+void Jit::flush() noexcept
+{
+    code_used = 0;
+    blocks.fill({ });
+    translated.fill(false);
+    chain_sites.clear();
+}
+
+void Jit::emit8(uint8_t value) noexcept {
+    code[code_used++] = value;
+}
+
+void Jit::emit16(uint16_t value) noexcept
+{
+    std::memcpy(code + code_used, &value, sizeof(value));
+    code_used += sizeof(value);
+}
+
+void Jit::emit32(uint32_t value) noexcept
+{
+    std::memcpy(code + code_used, &value, sizeof(value));
+    code_used += sizeof(value);
+}
+
+// [rdi + offset] as the memory operand
+void Jit::emit_modrm_cpu(uint8_t reg, uint32_t offset) noexcept
+{
+    emit8(0x80 | (reg << 3) | 0x7);
+    emit32(offset);
+}
+
+// Leave the block towards `target`, the jump is chained straight
+// into the target block once it is compiled and there is budget left
+void Jit::emit_exit(uint16_t target) noexcept
+{
+    // cmp qword [rsi], MAX_BLOCK_INSTRUCTIONS
+    emit8(0x48); emit8(0x83); emit8(0x3E); emit8(MAX_BLOCK_INSTRUCTIONS);
+    // jl exit
+    emit8(0x7C); emit8(0x05);
+    // jmp target block, falls through to the exit until it is chained
+    emit8(0xE9);
+    const size_t site = code_used;
+    emit32(0);
+
+    // exit: mov word [rdi + pc], target
+    emit8(0x66); emit8(0xC7); emit_modrm_cpu(0, OFFSET_PC); emit16(target);
+    // ret
+    emit8(0xC3);
+
+    if(target + 1 < MEMORY_SIZE && blocks[target].state == Block_state::COMPILED)
+    {
+        const auto entry = reinterpret_cast<uint8_t*>(blocks[target].function) - code;
+        const uint32_t relative = static_cast<uint32_t>(entry - static_cast<ptrdiff_t>(site + 4));
+        std::memcpy(code + site, &relative, sizeof(relative));
+    }
+    else
+        chain_sites.push_back({ site, target });
+}
+
+// Leave the block in front of the instruction at `address` without executing
+// it, emitted behind a jcc that skips exactly BAIL_BYTES when it doesn't trap
+void Jit::emit_bail(uint16_t address) noexcept
+{
+    // add qword [rsi], 1, the instruction was counted with the block
+    emit8(0x48); emit8(0x83); emit8(0x06); emit8(0x01);
+    // mov word [rdi + pc], address
+    emit8(0x66); emit8(0xC7); emit_modrm_cpu(0, OFFSET_PC); emit16(address);
+    // ret
+    emit8(0xC3);
+}
+
+Jit::Block Jit::compile(const Chip8& chip, uint16_t address) noexcept
+{
+    if(code_used + MAX_BLOCK_BYTES > CODE_BUFFER_SIZE)
+        flush();
+
+    const size_t entry = code_used;
+
+    // sub qword [rsi], count
+    emit8(0x48); emit8(0x81); emit8(0x2E);
+    const size_t count_site = code_used;
+    emit32(0);
+
+    uint32_t count = 0;
+    uint16_t pc = address;
+    bool ended = false;
+
+    while(not ended && count < MAX_BLOCK_INSTRUCTIONS && pc + 1 < MEMORY_SIZE)
+    {
+        const uint16_t opcode = (chip.memory[pc] << 8) | chip.memory[pc + 1];
+        const uint16_t nnn = opcode & 0xFFF;
+        const uint8_t  x   = (opcode >> 8) & 0xF;
+        const uint8_t  y   = (opcode >> 4) & 0xF;
+        const uint8_t  kk  = opcode & 0xFF;
+        const uint16_t next = pc + Chip8::INSTRUCTION_LONG;
+
+        // the code for a skip instruction, `skip_if_equal` picks the jcc
+        auto emit_skip = [&](bool skip_if_equal)
+        {
+            // je/jne rel32 to the not taken exit
+            emit8(0x0F); emit8(skip_if_equal ? 0x85 : 0x84);
+            const size_t site = code_used;
+            emit32(0);
+
+            emit_exit(next + Chip8::INSTRUCTION_LONG);
+
+            const uint32_t relative = static_cast<uint32_t>(code_used - (site + 4));
+            std::memcpy(code + site, &relative, sizeof(relative));
+
+            emit_exit(next);
+        };
+
+        bool translated_instruction = true;
+
+        switch(opcode & 0xF000)
+        {
+            case 0x0000:
+            // 00EE, the decode table only looks at the lowest nibble
+            if((opcode & 0x000F) == 0x000E)
+            {
+                // cmp byte [rdi + sp], 0; jne past the bail on an empty stack
+                emit8(0x80); emit_modrm_cpu(7, OFFSET_SP); emit8(0);
+                emit8(0x75); emit8(BAIL_BYTES);
+                emit_bail(pc);
+                // dec byte [rdi + sp]
+                emit8(0xFE); emit_modrm_cpu(1, OFFSET_SP);
+                // movzx eax, byte [rdi + sp]
+                emit8(0x0F); emit8(0xB6); emit_modrm_cpu(0, OFFSET_SP);
+                // movzx eax, word [rdi + rax * 2 + stack]
+                emit8(0x0F); emit8(0xB7); emit8(0x84); emit8(0x47); emit32(OFFSET_STACK);
+                // mov word [rdi + pc], ax
+                emit8(0x66); emit8(0x89); emit_modrm_cpu(AL, OFFSET_PC);
+                // ret
+                emit8(0xC3);
+                ended = true;
+            }
+            else
+                translated_instruction = false;
+            break;
+
+            case 0x1000:
+            emit_exit(nnn);
+            ended = true;
+            break;
+
+            case 0x2000:
+            // cmp byte [rdi + sp], STACK_SIZE; jb past the bail on a full stack
+            emit8(0x80); emit_modrm_cpu(7, OFFSET_SP); emit8(STACK_SIZE);
+            emit8(0x72); emit8(BAIL_BYTES);
+            emit_bail(pc);
+            // movzx eax, byte [rdi + sp]
+            emit8(0x0F); emit8(0xB6); emit_modrm_cpu(0, OFFSET_SP);
+            // mov word [rdi + rax * 2 + stack], next
+            emit8(0x66); emit8(0xC7); emit8(0x84); emit8(0x47); emit32(OFFSET_STACK); emit16(next);
+            // inc byte [rdi + sp]
+            emit8(0xFE); emit_modrm_cpu(0, OFFSET_SP);
+            emit_exit(nnn);
+            ended = true;
+            break;
+
+            case 0x3000: case 0x4000:
+            // cmp byte [rdi + Vx], kk
+            emit8(0x80); emit_modrm_cpu(7, register_offset(x)); emit8(kk);
+            emit_skip((opcode & 0xF000) == 0x3000);
+            ended = true;
+            break;
+
+            case 0x5000: case 0x9000:
+            // mov al, [rdi + Vx]
+            emit8(0x8A); emit_modrm_cpu(AL, register_offset(x));
+            // cmp al, [rdi + Vy]
+            emit8(0x3A); emit_modrm_cpu(AL, register_offset(y));
+            emit_skip((opcode & 0xF000) == 0x5000);
+            ended = true;
+            break;
+
+            case 0x6000:
+            // mov byte [rdi + Vx], kk
+            emit8(0xC6); emit_modrm_cpu(0, register_offset(x)); emit8(kk);
+            break;
+
+            case 0x7000:
+            // add byte [rdi + Vx], kk
+            emit8(0x80); emit_modrm_cpu(0, register_offset(x)); emit8(kk);
+            break;
+
+            case 0x8000:
+            switch(opcode & 0x000F)
+            {
+                case 0x0:
+                // mov al, [Vy]; mov [Vx], al
+                emit8(0x8A); emit_modrm_cpu(AL, register_offset(y));
+                emit8(0x88); emit_modrm_cpu(AL, register_offset(x));
+                break;
+
+                case 0x1: case 0x2: case 0x3:
+                {
+                    // or/and/xor [Vx], al
+                    static constexpr uint8_t operation[] { 0x08, 0x20, 0x30 };
+
+                    emit8(0x8A); emit_modrm_cpu(AL, register_offset(y));
+                    emit8(operation[(opcode & 0x000F) - 1]); emit_modrm_cpu(AL, register_offset(x));
+                }
+                break;
+
+                case 0x4:
+                // mov al, [Vx]; add al, [Vy]; setc cl
+                emit8(0x8A); emit_modrm_cpu(AL, register_offset(x));
+                emit8(0x02); emit_modrm_cpu(AL, register_offset(y));
+                emit8(0x0F); emit8(0x92); emit8(0xC1);
+                // VF is written before Vx, just like the interpreter
+                emit8(0x88); emit_modrm_cpu(CL, OFFSET_VF);
+                emit8(0x88); emit_modrm_cpu(AL, register_offset(x));
+                break;
+
+                case 0x5: case 0x7:
+                {
+                    // 8XY5 computes Vx - Vy, 8XY7 computes Vy - Vx
+                    const uint8_t lhs = (opcode & 0x000F) == 0x5 ? x : y;
+                    const uint8_t rhs = (opcode & 0x000F) == 0x5 ? y : x;
+
+                    // mov al, [lhs]; cmp al, [rhs]; seta cl; mov [VF], cl
+                    emit8(0x8A); emit_modrm_cpu(AL, register_offset(lhs));
+                    emit8(0x3A); emit_modrm_cpu(AL, register_offset(rhs));
+                    emit8(0x0F); emit8(0x97); emit8(0xC1);
+                    emit8(0x88); emit_modrm_cpu(CL, OFFSET_VF);
+                    // operands are read again in case one of them was VF
+                    // mov al, [lhs]; sub al, [rhs]; mov [Vx], al
+                    emit8(0x8A); emit_modrm_cpu(AL, register_offset(lhs));
+                    emit8(0x2A); emit_modrm_cpu(AL, register_offset(rhs));
+                    emit8(0x88); emit_modrm_cpu(AL, register_offset(x));
+                }
+                break;
+
+                case 0x6:
+                // mov al, [Vx]; and al, 1; mov [VF], al; shr byte [Vx], 1
+                emit8(0x8A); emit_modrm_cpu(AL, register_offset(x));
+                emit8(0x24); emit8(0x01);
+                emit8(0x88); emit_modrm_cpu(AL, OFFSET_VF);
+                emit8(0xD0); emit_modrm_cpu(5, register_offset(x));
+                break;
+
+                case 0xE:
+                // mov al, [Vx]; shr al, 7; mov [VF], al; shl byte [Vx], 1
+                emit8(0x8A); emit_modrm_cpu(AL, register_offset(x));
+                emit8(0xC0); emit8(0xE8); emit8(0x07);
+                emit8(0x88); emit_modrm_cpu(AL, OFFSET_VF);
+                emit8(0xD0); emit_modrm_cpu(4, register_offset(x));
+                break;
+
+                default:
+                translated_instruction = false;
+                break;
+            }
+            break;
+
+            case 0xA000:
+            // mov word [rdi + I], nnn
+            emit8(0x66); emit8(0xC7); emit_modrm_cpu(0, OFFSET_I); emit16(nnn);
+            break;
+
+            case 0xB000:
+            // movzx eax, byte [rdi + V0]; add eax, nnn; mov word [rdi + pc], ax; ret
+            emit8(0x0F); emit8(0xB6); emit_modrm_cpu(AL, register_offset(0));
+            emit8(0x05); emit32(nnn);
+            emit8(0x66); emit8(0x89); emit_modrm_cpu(AL, OFFSET_PC);
+            emit8(0xC3);
+            ended = true;
+            break;
+
+            case 0xF000:
+            if((opcode & 0xF0FF) == 0xF01E)
+            {
+                // movzx eax, byte [rdi + Vx]; add word [rdi + I], ax
+                emit8(0x0F); emit8(0xB6); emit_modrm_cpu(AL, register_offset(x));
+                emit8(0x66); emit8(0x01); emit_modrm_cpu(AL, OFFSET_I);
+            }
+            else
+                translated_instruction = false;
+            break;
+
+            // 00E0, CXKK, DXYN, EX9E, EXA1 and the rest of FX
+            // are left to the interpreter
+            default:
+            translated_instruction = false;
+            break;
+        }
+
+        if(not translated_instruction)
+            break;
+
+        count++;
+        pc = next;
+    }
+
+    // nothing could be translated, the interpreter runs this address
+    if(count == 0)
+    {
+        code_used = entry;
+        return { nullptr, Block_state::INTERPRET };
+    }
+
+    // the block stopped before an instruction it can't translate
+    if(not ended)
+        emit_exit(pc);
+
+    std::memcpy(code + count_site, &count, sizeof(count));
+
+    for(uint16_t i = address; i < pc && i < translated.size(); i++)
+        translated[i] = true;
+
+    const Block block { reinterpret_cast<Block_function>(code + entry), Block_state::COMPILED };
+
+    // chain every exit that was waiting for this block
+    for(auto site = chain_sites.begin(); site != chain_sites.end();)
+    {
+        if(site->target == address)
+        {
+            const uint32_t relative = static_cast<uint32_t>(entry - (site->offset + 4));
+            std::memcpy(code + site->offset, &relative, sizeof(relative));
+            site = chain_sites.erase(site);
+        }
+        else
+            site++;
+    }
+
+    return block;
+}
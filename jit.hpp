@@ -0,0 +1,105 @@
+#ifndef JIT_HPP
+#define JIT_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "chip8.hpp"
+
+// the JIT emits x86-64 machine code, everything else uses the interpreter
+#if defined(__x86_64__) && defined(__linux__)
+#define CHIP8_JIT_SUPPORTED 1
+#else
+#define CHIP8_JIT_SUPPORTED 0
+#endif
+
+// Dynamic recompiler that translates basic blocks of Chip8 code into
+// native code working directly on the CPU registers.
+// Instructions it can't translate are left to Chip8::cycle().
+class Jit
+{
+public:
+    Jit();
+    ~Jit();
+
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+
+    static constexpr bool is_supported() noexcept {
+        return CHIP8_JIT_SUPPORTED;
+    }
+
+    // execute up to `instructions` instructions, returns how many were executed
+    uint64_t run(Chip8& chip, uint64_t instructions) noexcept;
+
+    // drop every block translated from the written bytes
+    void invalidate(uint16_t address, size_t length) noexcept;
+
+private:
+    // compiled blocks take the CPU state and the remaining instruction budget
+    using Block_function = void (*)(void* cpu, int64_t* budget);
+
+    enum class Block_state : uint8_t
+    {
+        UNCOMPILED,
+        COMPILED,
+        INTERPRET // the first instruction can't be translated
+    };
+
+    struct Block
+    {
+        Block_function function = nullptr;
+        Block_state    state    = Block_state::UNCOMPILED;
+    };
+
+    // a jump inside a compiled block that waits for its target to be compiled
+    struct Chain_site
+    {
+        size_t   offset; // offset of the rel32 operand in the code buffer
+        uint16_t target;
+    };
+
+    Block_function lookup(const Chip8& chip, uint16_t address) noexcept;
+    Block compile(const Chip8& chip, uint16_t address) noexcept;
+    void emit_exit(uint16_t target) noexcept;
+    void emit_bail(uint16_t address) noexcept;
+    void flush() noexcept;
+    bool set_writable(bool enable) noexcept;
+
+    void emit8(uint8_t value) noexcept;
+    void emit16(uint16_t value) noexcept;
+    void emit32(uint32_t value) noexcept;
+    void emit_modrm_cpu(uint8_t reg, uint32_t offset) noexcept;
+
+private:
+    // Constants
+    enum
+    {
+        // blocks never grow past this amount of instructions, chaining into
+        // another block requires at least that much budget to be left
+        MAX_BLOCK_INSTRUCTIONS = 32,
+
+        // worst case size of a single block in bytes
+        MAX_BLOCK_BYTES = 64 * MAX_BLOCK_INSTRUCTIONS,
+
+        CODE_BUFFER_SIZE = 1 << 20,
+
+        // size of the code emit_bail() writes
+        BAIL_BYTES = 14
+    };
+
+    uint8_t* code      = nullptr;
+    size_t   code_used = 0;
+    bool     writable  = true;
+
+    std::array<Block, MEMORY_SIZE> blocks { };
+
+    // marks every memory byte that was translated into a block
+    std::array<bool, MEMORY_SIZE> translated { };
+
+    std::vector<Chain_site> chain_sites;
+};
+
+#endif // JIT_HPP
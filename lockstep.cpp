@@ -0,0 +1,601 @@
+#include "lockstep.hpp"
+
+#include <algorithm>
+
+// the AVX2 build of the lane loops needs GCC or Clang on x86-64
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CHIP8_LOCKSTEP_AVX2 1
+#else
+#define CHIP8_LOCKSTEP_AVX2 0
+#endif
+
+namespace
+{
+    // masks hold 0xFF for lanes taking part and 0x00 for the others,
+    // blending instead of branching keeps the lane loops vectorizable
+    constexpr uint8_t blend(uint8_t old_value, uint8_t new_value, uint8_t mask) noexcept {
+        return static_cast<uint8_t>((new_value & mask) | (old_value & ~mask));
+    }
+
+    constexpr uint16_t blend(uint16_t old_value, uint16_t new_value, uint8_t mask) noexcept
+    {
+        const auto wide = static_cast<uint16_t>(static_cast<int8_t>(mask));
+        return static_cast<uint16_t>((new_value & wide) | (old_value & ~wide));
+    }
+
+    constexpr uint8_t select(bool condition) noexcept {
+        return condition ? 0xFF : 0x00;
+    }
+
+    size_t lowest_bit(uint32_t bits) noexcept
+    {
+        #if defined(__GNUC__) || defined(__clang__)
+        return static_cast<size_t>(__builtin_ctz(bits));
+        #else
+        size_t bit = 0;
+        while((bits >> bit & 1) == 0)
+            bit++;
+
+        return bit;
+        #endif
+    }
+
+    constexpr uint32_t all_lanes(size_t lanes) noexcept {
+        return lanes == 32 ? 0xFFFFFFFF : (1u << lanes) - 1;
+    }
+
+    constexpr auto VF = REGISTER_SIZE - 1;
+    constexpr auto INSTRUCTION_LONG = Chip8::INSTRUCTION_LONG;
+
+    // a bit for every register an instruction left to the lanes' machines
+    // reads or writes, only those are copied to the machine and back
+    constexpr uint16_t scalar_registers(uint16_t opcode) noexcept
+    {
+        const auto x = static_cast<uint16_t>(1u << (opcode >> 8 & 0xF));
+        const auto y = static_cast<uint16_t>(1u << (opcode >> 4 & 0xF));
+
+        switch(opcode >> 12)
+        {
+            case 0xC: case 0xE:
+                return x;
+
+            case 0xD:
+                return static_cast<uint16_t>(x | y | 1u << VF);
+
+            case 0xF:
+                if((opcode & 0xFF) == 0x55 || (opcode & 0xFF) == 0x65)
+                    return static_cast<uint16_t>((x << 1) - 1);
+                return x;
+
+            default:
+                break;
+        }
+
+        // 00E0, calls and returns that trap, illegal opcodes
+        return 0;
+    }
+}
+
+template<size_t LANES>
+Lockstep_group<LANES>::Lockstep_group(const Chip8& machine, uint64_t first_seed)
+{
+    machines.reserve(LANES);
+
+    for(size_t lane = 0; lane < LANES; lane++)
+    {
+        machines.push_back(machine.fork());
+        machines.back().seed(first_seed + lane);
+
+        for(size_t r = 0; r < REGISTER_SIZE; r++)
+            V[r][lane] = machine.registers[r];
+
+        for(size_t depth = 0; depth < STACK_SIZE; depth++)
+            stack[depth][lane] = machine.stack[depth];
+
+        pc[lane] = machine.pc;
+        I[lane]  = machine.I;
+        sp[lane] = machine.sp;
+        dt[lane] = machine.dt;
+        st[lane] = machine.st;
+    }
+}
+
+template<size_t LANES>
+bool Lockstep_group<LANES>::uses_avx2() noexcept
+{
+    #if CHIP8_LOCKSTEP_AVX2
+    return __builtin_cpu_supports("avx2");
+    #else
+    return false;
+    #endif // CHIP8_LOCKSTEP_AVX2
+}
+
+template<size_t LANES>
+uint64_t Lockstep_group<LANES>::run(uint64_t steps) noexcept
+{
+    if(uses_avx2())
+        run_steps_avx2(steps);
+    else
+        run_steps(steps);
+
+    return steps * LANES;
+}
+
+template<size_t LANES>
+void Lockstep_group<LANES>::run_steps(uint64_t steps) noexcept
+{
+    for(uint64_t i = 0; i < steps; i++)
+        step();
+}
+
+// everything step() calls is inlined here and built again for AVX2
+template<size_t LANES>
+#if CHIP8_LOCKSTEP_AVX2
+__attribute__((target("avx2"), flatten))
+#endif // CHIP8_LOCKSTEP_AVX2
+void Lockstep_group<LANES>::run_steps_avx2(uint64_t steps) noexcept
+{
+    for(uint64_t i = 0; i < steps; i++)
+        step();
+}
+
+template<size_t LANES>
+void Lockstep_group<LANES>::tick_timers() noexcept
+{
+    for(size_t lane = 0; lane < LANES; lane++)
+    {
+        dt[lane] = static_cast<uint8_t>(dt[lane] - (dt[lane] > 0));
+        st[lane] = static_cast<uint8_t>(st[lane] - (st[lane] > 0));
+    }
+}
+
+template<size_t LANES>
+void Lockstep_group<LANES>::set_key(size_t lane, uint8_t key, bool pressed) noexcept {
+    machines[lane].keypads[key % KEYPADS_SIZE] = pressed;
+}
+
+template<size_t LANES>
+const Chip8& Lockstep_group<LANES>::get_lane(size_t lane) noexcept
+{
+    Chip8& machine = machines[lane];
+
+    for(size_t r = 0; r < REGISTER_SIZE; r++)
+        machine.registers[r] = V[r][lane];
+
+    for(size_t depth = 0; depth < STACK_SIZE; depth++)
+        machine.stack[depth] = stack[depth][lane];
+
+    machine.pc = pc[lane];
+    machine.I  = I[lane];
+    machine.sp = sp[lane];
+    machine.dt = dt[lane];
+    machine.st = st[lane];
+
+    return machine;
+}
+
+template<size_t LANES>
+uint16_t Lockstep_group<LANES>::fetch(size_t lane, uint16_t address) const noexcept
+{
+    const auto& memory = machines[lane].memory;
+    return static_cast<uint16_t>(memory[address] << 8 | memory[address + 1]);
+}
+
+// Execute one instruction on every lane, the lanes at the same address
+// as the first lane left run together until no lane is left
+template<size_t LANES>
+void Lockstep_group<LANES>::step() noexcept
+{
+    Lane_bytes pending;
+    pending.fill(0xFF);
+
+    uint32_t remaining = all_lanes(LANES);
+    while(remaining != 0)
+    {
+        const size_t   leader  = lowest_bit(remaining);
+        const uint16_t address = pc[leader];
+
+        // past the end of memory the interpreter decides what happens
+        if(address >= MEMORY_SIZE - 1)
+        {
+            execute_scalar(1u << leader, 0);
+            pending[leader] = 0;
+            remaining &= ~(1u << leader);
+            continue;
+        }
+
+        const uint16_t opcode = fetch(leader, address);
+
+        Lane_bytes mask;
+        for(size_t lane = 0; lane < LANES; lane++)
+            mask[lane] = pending[lane] & select(pc[lane] == address);
+
+        // a lane may have written other code at this address
+        if(not code_shared)
+        {
+            for(size_t lane = 0; lane < LANES; lane++)
+            {
+                if(mask[lane] != 0 && fetch(lane, address) != opcode)
+                    mask[lane] = 0;
+            }
+        }
+
+        uint32_t lanes = 0;
+        for(size_t lane = 0; lane < LANES; lane++)
+            lanes |= static_cast<uint32_t>(mask[lane] & 1) << lane;
+
+        if(execute_vector(opcode, mask))
+            vector_groups++;
+        else
+        {
+            execute_scalar(lanes, scalar_registers(opcode));
+            check_shared_code(lanes, opcode);
+        }
+
+        for(size_t lane = 0; lane < LANES; lane++)
+            pending[lane] &= static_cast<uint8_t>(~mask[lane]);
+
+        remaining &= ~lanes;
+    }
+}
+
+// decoded the same way as Chip8::make_decode_table(),
+// returns false for the instructions each lane has to run on its own
+template<size_t LANES>
+bool Lockstep_group<LANES>::execute_vector(uint16_t opcode, const Lane_bytes& mask) noexcept
+{
+    const uint8_t  x   = opcode >> 8 & 0xF;
+    const uint8_t  y   = opcode >> 4 & 0xF;
+    const uint8_t  kk  = opcode & 0xFF;
+    const uint16_t nnn = opcode & 0xFFF;
+
+    auto& Vx = V[x];
+    auto& Vy = V[y];
+    auto& Vf = V[VF];
+
+    // the vector instructions move past themselves first, like the interpreter
+    auto advance = [&]
+    {
+        for(size_t lane = 0; lane < LANES; lane++)
+            pc[lane] = static_cast<uint16_t>(pc[lane] + (mask[lane] & INSTRUCTION_LONG));
+    };
+
+    // skip the next instruction in the lanes where `condition` holds
+    auto skip_if = [&](auto condition)
+    {
+        for(size_t lane = 0; lane < LANES; lane++)
+        {
+            const uint8_t taken = mask[lane] & select(condition(lane));
+            pc[lane] = static_cast<uint16_t>(pc[lane] + (mask[lane] & INSTRUCTION_LONG) + (taken & INSTRUCTION_LONG));
+        }
+    };
+
+    switch(opcode >> 12)
+    {
+        case 0x0:
+            // 00EE, the return address is different in every lane,
+            // lanes with an empty stack raise the trap on their own machine
+            if((opcode & 0xF) == 0xE)
+            {
+                uint32_t faulting = 0;
+                for(size_t lane = 0; lane < LANES; lane++)
+                {
+                    if(mask[lane] == 0)
+                        continue;
+
+                    if(sp[lane] == 0)
+                    {
+                        faulting |= 1u << lane;
+                        continue;
+                    }
+
+                    sp[lane]--;
+                    pc[lane] = stack[sp[lane]][lane];
+                }
+
+                execute_scalar(faulting, 0);
+                return true;
+            }
+            break;
+
+        case 0x1:
+            for(size_t lane = 0; lane < LANES; lane++)
+                pc[lane] = blend(pc[lane], nnn, mask[lane]);
+            return true;
+
+        case 0x2:
+        {
+            uint32_t faulting = 0;
+            for(size_t lane = 0; lane < LANES; lane++)
+            {
+                if(mask[lane] == 0)
+                    continue;
+
+                if(sp[lane] >= STACK_SIZE)
+                {
+                    faulting |= 1u << lane;
+                    continue;
+                }
+
+                stack[sp[lane]][lane] = static_cast<uint16_t>(pc[lane] + INSTRUCTION_LONG);
+                sp[lane]++;
+                pc[lane] = nnn;
+            }
+
+            execute_scalar(faulting, 0);
+            return true;
+        }
+
+        case 0x3: skip_if([&](size_t lane) { return Vx[lane] == kk; }); return true;
+        case 0x4: skip_if([&](size_t lane) { return Vx[lane] != kk; }); return true;
+        case 0x5: skip_if([&](size_t lane) { return Vx[lane] == Vy[lane]; }); return true;
+        case 0x9: skip_if([&](size_t lane) { return Vx[lane] != Vy[lane]; }); return true;
+
+        case 0x6:
+            advance();
+            for(size_t lane = 0; lane < LANES; lane++)
+                Vx[lane] = blend(Vx[lane], kk, mask[lane]);
+            return true;
+
+        case 0x7:
+            advance();
+            for(size_t lane = 0; lane < LANES; lane++)
+                Vx[lane] = blend(Vx[lane], static_cast<uint8_t>(Vx[lane] + kk), mask[lane]);
+            return true;
+
+        // VF is written before Vx like in the interpreter, it matters when x or y is F
+        case 0x8:
+            switch(opcode & 0xF)
+            {
+                case 0x0:
+                    advance();
+                    for(size_t lane = 0; lane < LANES; lane++)
+                        Vx[lane] = blend(Vx[lane], Vy[lane], mask[lane]);
+                    return true;
+
+                case 0x1:
+                    advance();
+                    for(size_t lane = 0; lane < LANES; lane++)
+                        Vx[lane] = blend(Vx[lane], static_cast<uint8_t>(Vx[lane] | Vy[lane]), mask[lane]);
+                    return true;
+
+                case 0x2:
+                    advance();
+                    for(size_t lane = 0; lane < LANES; lane++)
+                        Vx[lane] = blend(Vx[lane], static_cast<uint8_t>(Vx[lane] & Vy[lane]), mask[lane]);
+                    return true;
+
+                case 0x3:
+                    advance();
+                    for(size_t lane = 0; lane < LANES; lane++)
+                        Vx[lane] = blend(Vx[lane], static_cast<uint8_t>(Vx[lane] ^ Vy[lane]), mask[lane]);
+                    return true;
+
+                case 0x4:
+                    advance();
+                    for(size_t lane = 0; lane < LANES; lane++)
+                    {
+                        const uint16_t sum = Vx[lane] + Vy[lane];
+                        Vf[lane] = blend(Vf[lane], static_cast<uint8_t>(sum > 255), mask[lane]);
+                        Vx[lane] = blend(Vx[lane], static_cast<uint8_t>(sum), mask[lane]);
+                    }
+                    return true;
+
+                case 0x5:
+                    advance();
+                    for(size_t lane = 0; lane < LANES; lane++)
+                    {
+                        Vf[lane] = blend(Vf[lane], static_cast<uint8_t>(Vx[lane] > Vy[lane]), mask[lane]);
+                        Vx[lane] = blend(Vx[lane], static_cast<uint8_t>(Vx[lane] - Vy[lane]), mask[lane]);
+                    }
+                    return true;
+
+                case 0x6:
+                    advance();
+                    for(size_t lane = 0; lane < LANES; lane++)
+                    {
+                        Vf[lane] = blend(Vf[lane], static_cast<uint8_t>(Vx[lane] & 0x1), mask[lane]);
+                        Vx[lane] = blend(Vx[lane], static_cast<uint8_t>(Vx[lane] >> 1), mask[lane]);
+                    }
+                    return true;
+
+                case 0x7:
+                    advance();
+                    for(size_t lane = 0; lane < LANES; lane++)
+                    {
+                        Vf[lane] = blend(Vf[lane], static_cast<uint8_t>(Vy[lane] > Vx[lane]), mask[lane]);
+                        Vx[lane] = blend(Vx[lane], static_cast<uint8_t>(Vy[lane] - Vx[lane]), mask[lane]);
+                    }
+                    return true;
+
+                case 0xE:
+                    advance();
+                    for(size_t lane = 0; lane < LANES; lane++)
+                    {
+                        Vf[lane] = blend(Vf[lane], static_cast<uint8_t>(Vx[lane] >> 7), mask[lane]);
+                        Vx[lane] = blend(Vx[lane], static_cast<uint8_t>(Vx[lane] << 1), mask[lane]);
+                    }
+                    return true;
+
+                default:
+                    break;
+            }
+            break;
+
+        case 0xA:
+            advance();
+            for(size_t lane = 0; lane < LANES; lane++)
+                I[lane] = blend(I[lane], nnn, mask[lane]);
+            return true;
+
+        case 0xB:
+            for(size_t lane = 0; lane < LANES; lane++)
+                pc[lane] = blend(pc[lane], static_cast<uint16_t>(V[0][lane] + nnn), mask[lane]);
+            return true;
+
+        case 0xF:
+            switch(kk)
+            {
+                case 0x07:
+                    advance();
+                    for(size_t lane = 0; lane < LANES; lane++)
+                        Vx[lane] = blend(Vx[lane], dt[lane], mask[lane]);
+                    return true;
+
+                case 0x15:
+                    advance();
+                    for(size_t lane = 0; lane < LANES; lane++)
+                        dt[lane] = blend(dt[lane], Vx[lane], mask[lane]);
+                    return true;
+
+                case 0x18:
+                    advance();
+                    for(size_t lane = 0; lane < LANES; lane++)
+                        st[lane] = blend(st[lane], Vx[lane], mask[lane]);
+                    return true;
+
+                case 0x1E:
+                    advance();
+                    for(size_t lane = 0; lane < LANES; lane++)
+                        I[lane] = blend(I[lane], static_cast<uint16_t>(I[lane] + Vx[lane]), mask[lane]);
+                    return true;
+
+                case 0x29:
+                    advance();
+                    for(size_t lane = 0; lane < LANES; lane++)
+                        I[lane] = blend(I[lane], static_cast<uint16_t>(Vx[lane]), mask[lane]);
+                    return true;
+
+                // each lane loads from its own memory, lanes reading
+                // past the end raise the trap on their own machine
+                case 0x65:
+                {
+                    uint32_t faulting = 0;
+                    for(size_t lane = 0; lane < LANES; lane++)
+                    {
+                        if(mask[lane] == 0)
+                            continue;
+
+                        if(I[lane] + x >= MEMORY_SIZE)
+                        {
+                            faulting |= 1u << lane;
+                            continue;
+                        }
+
+                        const auto& memory = machines[lane].memory;
+                        for(size_t r = 0; r <= x; r++)
+                            V[r][lane] = memory[I[lane] + r];
+
+                        pc[lane] = static_cast<uint16_t>(pc[lane] + INSTRUCTION_LONG);
+                    }
+
+                    execute_scalar(faulting, scalar_registers(opcode));
+                    return true;
+                }
+
+                default:
+                    break;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    // stores, display, keypad, random numbers and illegal opcodes
+    return false;
+}
+
+// run the instruction at pc of every lane in `lanes` through its own machine,
+// `registers` has a bit for every register the instruction uses
+template<size_t LANES>
+void Lockstep_group<LANES>::execute_scalar(uint32_t lanes, uint16_t registers) noexcept
+{
+    for(; lanes != 0; lanes &= lanes - 1)
+    {
+        const size_t lane = lowest_bit(lanes);
+        Chip8& machine = machines[lane];
+
+        for(uint32_t used = registers; used != 0; used &= used - 1)
+        {
+            const size_t r = lowest_bit(used);
+            machine.registers[r] = V[r][lane];
+        }
+
+        machine.pc = pc[lane];
+        machine.I  = I[lane];
+        machine.sp = sp[lane];
+
+        machine.cycle();
+        scalar_instructions++;
+
+        for(uint32_t used = registers; used != 0; used &= used - 1)
+        {
+            const size_t r = lowest_bit(used);
+            V[r][lane] = machine.registers[r];
+        }
+
+        pc[lane] = machine.pc;
+        I[lane]  = machine.I;
+        sp[lane] = machine.sp;
+    }
+}
+
+// FX33 and FX55 are the only writes to memory, as long as every lane
+// wrote the same bytes the lanes still share their code
+template<size_t LANES>
+void Lockstep_group<LANES>::check_shared_code(uint32_t lanes, uint16_t opcode) noexcept
+{
+    const uint16_t store = opcode & 0xF0FF;
+    if(not code_shared || (store != 0xF033 && store != 0xF055))
+        return;
+
+    const size_t x      = opcode >> 8 & 0xF;
+    const size_t length = store == 0xF033 ? 3 : x + 1;
+
+    // the memories were equal before, when every lane stored the same
+    // registers at the same address they still are
+    if(lanes == all_lanes(LANES))
+    {
+        uint8_t differs = 0;
+        for(size_t lane = 0; lane < LANES; lane++)
+            differs |= select(I[lane] != I[0]);
+
+        for(size_t r = store == 0xF033 ? x : 0; r <= x; r++)
+        {
+            for(size_t lane = 0; lane < LANES; lane++)
+                differs |= V[r][lane] ^ V[r][0];
+        }
+
+        if(differs == 0)
+            return;
+    }
+
+    uint32_t checked_address = UINT32_MAX;
+    for(; lanes != 0; lanes &= lanes - 1)
+    {
+        const size_t address = I[lowest_bit(lanes)];
+
+        // most of the time every lane wrote to the same place
+        if(address == checked_address || address >= MEMORY_SIZE)
+            continue;
+
+        checked_address = static_cast<uint32_t>(address);
+
+        const auto first = machines[0].memory.begin() + address;
+        const auto last  = machines[0].memory.begin() + std::min<size_t>(address + length, MEMORY_SIZE);
+
+        for(size_t lane = 1; lane < LANES; lane++)
+        {
+            if(not std::equal(first, last, machines[lane].memory.begin() + address))
+            {
+                code_shared = false;
+                return;
+            }
+        }
+    }
+}
+
+template class Lockstep_group<8>;
+template class Lockstep_group<16>;
+template class Lockstep_group<32>;
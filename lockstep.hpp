@@ -0,0 +1,83 @@
+#ifndef LOCKSTEP_HPP
+#define LOCKSTEP_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "chip8.hpp"
+
+// Runs LANES machines of the same program side by side.
+// The registers, pc, I, the stack and the timers of every lane are stored
+// together so an instruction shared by many lanes runs as one vector operation.
+// Lanes at another address are run in their own group, loads read each lane's
+// memory, and stores, drawing, the keypad and random numbers go through each
+// lane's Chip8 one lane at a time. Programs that mostly do those, or whose
+// lanes rarely share an address, run faster as independent forks.
+template<size_t LANES>
+class Lockstep_group
+{
+public:
+    static_assert(LANES == 8 || LANES == 16 || LANES == 32, "a group has 8, 16 or 32 lanes");
+
+    using Lane_bytes = std::array<uint8_t, LANES>;
+    using Lane_words = std::array<uint16_t, LANES>;
+
+    // every lane starts as a fork of `machine`, lane i is seeded with first_seed + i
+    Lockstep_group(const Chip8& machine, uint64_t first_seed);
+
+    // execute `steps` instructions on every lane, returns the instructions
+    // executed over all lanes
+    uint64_t run(uint64_t steps) noexcept;
+
+    // decrease the timers of every lane once, meant to be called at 60Hz
+    void tick_timers() noexcept;
+
+    void set_key(size_t lane, uint8_t key, bool pressed) noexcept;
+
+    // the machine of a lane brought up to date, its cycle counter isn't advanced
+    const Chip8& get_lane(size_t lane) noexcept;
+
+    // how many groups ran as a vector operation and how many lane instructions
+    // went through a Chip8 of their own
+    constexpr uint64_t get_vector_groups() const noexcept { return vector_groups; }
+    constexpr uint64_t get_scalar_instructions() const noexcept { return scalar_instructions; }
+
+    // whether run() uses the AVX2 build of the lane loops
+    static bool uses_avx2() noexcept;
+
+private:
+    // the same loop, once built for the baseline and once for AVX2
+    void run_steps(uint64_t steps) noexcept;
+    void run_steps_avx2(uint64_t steps) noexcept;
+
+    void step() noexcept;
+    bool execute_vector(uint16_t opcode, const Lane_bytes& mask) noexcept;
+    void execute_scalar(uint32_t lanes, uint16_t registers) noexcept;
+    void check_shared_code(uint32_t lanes, uint16_t opcode) noexcept;
+    uint16_t fetch(size_t lane, uint16_t address) const noexcept;
+
+    alignas(32) std::array<Lane_bytes, REGISTER_SIZE> V { };
+    alignas(32) std::array<Lane_words, STACK_SIZE>    stack { };
+    alignas(32) Lane_words pc { };
+    alignas(32) Lane_words I  { };
+    alignas(32) Lane_bytes sp { };
+    alignas(32) Lane_bytes dt { };
+    alignas(32) Lane_bytes st { };
+
+    // memory, display, keypad and random generator of every lane
+    std::vector<Chip8> machines;
+
+    // as long as no lane wrote anything different, one fetch serves every lane
+    bool code_shared = true;
+
+    uint64_t vector_groups       = 0;
+    uint64_t scalar_instructions = 0;
+};
+
+extern template class Lockstep_group<8>;
+extern template class Lockstep_group<16>;
+extern template class Lockstep_group<32>;
+
+#endif // LOCKSTEP_HPP
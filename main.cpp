@@ -1,48 +1,588 @@
+#if not HEADLESS_ONLY
 #include <SDL2/SDL.h>
+#endif // not HEADLESS_ONLY
 
 #include <iostream>
 #include <exception>
+#include <stdexcept>
+#include <string>
+#include <cstdlib>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <fstream>
 
 #include "chip8.hpp"
+#include "headless.hpp"
+#include "scheduler.hpp"
+#include "replay.hpp"
+#include "rewind.hpp"
+#include "profiler.hpp"
+#include "tracer.hpp"
+#include "metrics.hpp"
+#include "audio.hpp"
+#include "input.hpp"
+#include "capture.hpp"
+#include "renderer.hpp"
+#include "terminal.hpp"
+#include "triple_buffer.hpp"
+
+#if not HEADLESS_ONLY
 #include "window.hpp"
+#include "audio_device.hpp"
+#endif // not HEADLESS_ONLY
 
-constexpr auto WINDOW_SIZE     = 15;
-constexpr auto FRAMERATE_LIMIT = 500;
+constexpr auto WINDOW_SIZE = 15;
 
-int main(int argv, char* argc[])
+// longest sleep of a program waiting for a key, keeps the stats coming while nothing happens
+constexpr auto IDLE_TIMEOUT_MS = 250;
+
+namespace
 {
-    // Debug mode is operating system specific
-    #if ENABLE_DEBUG_MODE
-        #if (!__linux__ && !_WIN32)
-        throw std::runtime_error("Debug mode is not available to your operating system!");
-        #endif // not linux && windows
-    #endif // ENABLE_DEBUG_MODE
-    
-    // the second argument is the path to the game
-    // the program won't start without a path or too much paths
-    if(argv == 2)
-    {   
-        Window window("Chip8 Emulator", WINDOW_SIZE * CHIP8_WIDTH, WINDOW_SIZE * CHIP8_HEIGHT, CHIP8_WIDTH, CHIP8_HEIGHT);
-        Chip8 chip(argc[1]);
-
-        Uint32 start_fps;
-        while(window.is_running())
-        {
-            start_fps = SDL_GetTicks();
-
-            chip.cycle();
-            window.event_handler(chip.keypads);
-            window.update(chip.display);
-
-            // FPS Cap
-            if(1000 / FRAMERATE_LIMIT > SDL_GetTicks() - start_fps)
-                SDL_Delay(1000 / FRAMERATE_LIMIT - (SDL_GetTicks() - start_fps));
+    // where the frames of an interactive run go
+    enum class Output : uint8_t
+    {
+        SDL,
+        TERMINAL,
+        NONE
+    };
+
+    struct Options
+    {
+        std::string      rom_path;
+        Output           output     = Output::SDL;
+        bool             headless   = false;
+        bool             jit        = false;
+        bool             no_cache   = false;
+        bool             no_fusion  = false;
+        bool             turbo      = false;
+        bool             threaded   = false;
+        bool             has_seed   = false;
+        uint64_t         seed       = 0;
+        std::string      record_path;
+        std::string      replay_path;
+        std::string      load_state_path;
+        std::string      save_state_path;
+        uint64_t         rewind_seconds = 0;
+        std::string      profile_prefix;
+        std::string      trace_path;
+        std::string      stats_path;
+        bool             overlay    = false;
+        bool             mute       = false;
+        uint64_t         audio_buffer = 512;
+        std::string      wav_path;
+        std::string      keymap_path;
+        std::string      capture_path;
+        Capture::Format  capture_format = Capture::Format::DELTA;
+        uint64_t         keyframes      = 0;
+        Headless_options run;
+    };
+
+    void print_usage()
+    {
+        std::cerr << "Usage: chip8 [options] <rom>\n"
+                  << "  --headless        run without a window and print the final state\n"
+                  << "  --renderer <r>    sdl, terminal or null (default sdl)\n"
+                  << "  --cycles <n>      headless: stop after n instructions\n"
+                  << "  --frames <n>      stop after n frames\n"
+                  << "  --clock <hz>      instructions per emulated second (default 500)\n"
+                  << "  --turbo           don't wait between frames\n"
+                  << "  --threaded        emulate on its own thread, apart from the window\n"
+                  << "  --seed <n>        seed of the random number generator\n"
+                  << "  --record <file>   record the keypad to replay the run later\n"
+                  << "  --replay <file>   replay a recording headless, as fast as possible\n"
+                  << "  --load-state <f>  start from a save state\n"
+                  << "  --save-state <f>  save the state when the run ends\n"
+                  << "  --rewind <s>      keep s seconds of history, hold backspace to go back\n"
+                  << "  --jit             use the JIT backend\n"
+                  << "  --no-cache        decode every instruction again\n"
+                  << "  --no-fusion       don't fuse instruction sequences\n"
+                  << "  --trace <file>    write every executed instruction to a binary trace\n"
+                  << "  --stats <file>    write throughput and frame times to a file every second\n"
+                  << "  --overlay         draw the frame time split over the display\n"
+                  << "  --keymap <file>   keypad layout, one \"<keypad digit> <host key>\" per line\n"
+                  << "  --mute            don't open an audio device\n"
+                  << "  --audio-buffer <n> samples per audio callback, a power of two (default 512)\n"
+                  << "  --wav <file>      headless: write the sound to a WAV file\n"
+                  << "  --capture <file>  headless: write every frame that changed the display\n"
+                  << "  --capture-format <f> raw (64x32 gray frames) or delta (changed rows, the default)\n"
+                  << "  --keyframes <n>   with --capture, also save <file>.<frame>.ppm every n frames\n"
+                  #if ENABLE_PROFILER
+                  << "  --profile <path>  profile the run, writes <path>.json and <path>.folded\n"
+                  #endif // ENABLE_PROFILER
+                  ;
+    }
+
+    // returns false when the arguments make no sense
+    bool parse_options(int argc, char* argv[], Options& options)
+    {
+        for(int i = 1; i < argc; i++)
+        {
+            const std::string argument = argv[i];
+            const bool has_value = i + 1 < argc;
+
+            if(argument == "--headless")
+                options.headless = true;
+            else if(argument == "--renderer" && has_value)
+            {
+                const std::string output = argv[++i];
+                if(output == "sdl")
+                    options.output = Output::SDL;
+                else if(output == "terminal")
+                    options.output = Output::TERMINAL;
+                else if(output == "null")
+                    options.output = Output::NONE;
+                else
+                    return false;
+            }
+            else if(argument == "--cycles" && has_value)
+                options.run.instructions = std::strtoull(argv[++i], nullptr, 10);
+            else if(argument == "--frames" && has_value)
+                options.run.frames = std::strtoull(argv[++i], nullptr, 10);
+            else if(argument == "--clock" && has_value)
+                options.run.clock = std::strtoull(argv[++i], nullptr, 10);
+            else if(argument == "--turbo")
+                options.turbo = true;
+            else if(argument == "--threaded")
+                options.threaded = true;
+            else if(argument == "--seed" && has_value)
+            {
+                options.has_seed = true;
+                options.seed     = std::strtoull(argv[++i], nullptr, 10);
+            }
+            else if(argument == "--record" && has_value)
+                options.record_path = argv[++i];
+            else if(argument == "--replay" && has_value)
+                options.replay_path = argv[++i];
+            else if(argument == "--load-state" && has_value)
+                options.load_state_path = argv[++i];
+            else if(argument == "--save-state" && has_value)
+                options.save_state_path = argv[++i];
+            else if(argument == "--rewind" && has_value)
+                options.rewind_seconds = std::strtoull(argv[++i], nullptr, 10);
+            else if(argument == "--jit")
+                options.jit = true;
+            else if(argument == "--no-cache")
+                options.no_cache = true;
+            else if(argument == "--no-fusion")
+                options.no_fusion = true;
+            else if(argument == "--trace" && has_value)
+                options.trace_path = argv[++i];
+            else if(argument == "--stats" && has_value)
+                options.stats_path = argv[++i];
+            else if(argument == "--overlay")
+                options.overlay = true;
+            else if(argument == "--keymap" && has_value)
+                options.keymap_path = argv[++i];
+            else if(argument == "--mute")
+                options.mute = true;
+            else if(argument == "--audio-buffer" && has_value)
+                options.audio_buffer = std::strtoull(argv[++i], nullptr, 10);
+            else if(argument == "--wav" && has_value)
+                options.wav_path = argv[++i];
+            else if(argument == "--capture" && has_value)
+                options.capture_path = argv[++i];
+            else if(argument == "--capture-format" && has_value)
+            {
+                const std::string format = argv[++i];
+                if(format == "raw")
+                    options.capture_format = Capture::Format::RAW;
+                else if(format == "delta")
+                    options.capture_format = Capture::Format::DELTA;
+                else
+                    return false;
+            }
+            else if(argument == "--keyframes" && has_value)
+                options.keyframes = std::strtoull(argv[++i], nullptr, 10);
+            #if ENABLE_PROFILER
+            else if(argument == "--profile" && has_value)
+                options.profile_prefix = argv[++i];
+            #endif // ENABLE_PROFILER
+            else if(options.rom_path.empty() && argument.rfind("--", 0) != 0)
+                options.rom_path = argument;
+            else
+                return false;
+        }
+
+        // a replay is headless and stops where the recording stopped
+        if(not options.replay_path.empty())
+            options.headless = true;
+        else if(options.headless && options.run.instructions == 0 && options.run.frames == 0)
+            return false;
+
+        // nothing to record, rewind, measure or press without a window
+        if(options.headless && (not options.record_path.empty() || options.rewind_seconds > 0 ||
+                                not options.stats_path.empty() || options.overlay || not options.keymap_path.empty()))
+            return false;
+
+        // rewinding needs the emulation on the window thread
+        // and can't be replayed
+        if(options.rewind_seconds > 0 && (options.threaded || not options.record_path.empty()))
+            return false;
+
+        // a recording starts from the ROM and the seed, not from a save state
+        if(not options.load_state_path.empty() && (not options.record_path.empty() || not options.replay_path.empty()))
+            return false;
+
+        // the window plays the sound itself and shows the frames
+        if(not options.headless && (not options.wav_path.empty() || not options.capture_path.empty()))
+            return false;
+
+        if(options.keyframes > 0 && options.capture_path.empty())
+            return false;
+
+        if(options.run.clock == 0 || options.audio_buffer == 0 || options.audio_buffer > UINT16_MAX)
+            return false;
+
+        return not options.rom_path.empty();
+    }
+
+    // the share of every phase and the 99th percentile frame time,
+    // a full bar is two frames long
+    void show_metrics(Renderer& renderer, const Metrics& metrics) noexcept
+    {
+        const Metrics::Snapshot& snapshot = metrics.get_snapshot();
+
+        std::array<float, Metrics::PHASE_COUNT + 1> bars;
+        for(size_t i = 0; i < Metrics::PHASE_COUNT; i++)
+            bars[i] = static_cast<float>(snapshot.phase_share[i]);
+
+        bars.back() = static_cast<float>(snapshot.frame_p99_ms * Scheduler::FRAME_RATE / 2000);
+        renderer.set_overlay(bars.data(), bars.size());
+    }
+
+    // called once per presented frame
+    void end_frame(Renderer& renderer, Metrics* metrics, bool overlay)
+    {
+        if(metrics && metrics->end_frame() && overlay)
+            show_metrics(renderer, *metrics);
+    }
+
+    // ends with the renderer or once the frame budget is spent
+    bool has_frames_left(const Scheduler& scheduler, const Options& options) noexcept {
+        return options.run.frames == 0 || scheduler.get_frames() < options.run.frames;
+    }
+
+    // The renderer stays on this thread, SDL wants its events handled where it was initialized.
+    // The emulation thread publishes every frame that changed the display and
+    // applies the key transitions queued since the last frame.
+    void run_threaded(Chip8& chip, Renderer& renderer, const Options& options, Input_recorder* recorder, Metrics* metrics)
+    {
+        Triple_buffer<Framebuffer::Packed_display> frames;
+        Input_queue       input;
+        std::atomic<bool> running { true };
+
+        std::thread emulation([&]
+        {
+            Scheduler scheduler(options.run.clock, options.turbo);
+            while(running.load(std::memory_order_relaxed) && has_frames_left(scheduler, options))
+            {
+                input.drain(chip, recorder);
+
+                {
+                    Metrics::Scope scope(metrics, Metrics::Phase::EMULATE);
+                    const uint64_t executed = scheduler.run_frame(chip);
+
+                    if(metrics)
+                        metrics->add_instructions(executed);
+                }
+
+                if(chip.get_dirty_rows() != 0)
+                {
+                    frames.write_buffer() = chip.display;
+                    frames.publish();
+                    chip.clear_dirty_rows();
+                }
+
+                Metrics::Scope scope(metrics, Metrics::Phase::WAIT);
+                scheduler.wait_next_frame();
+            }
+
+            running.store(false, std::memory_order_relaxed);
+        });
+
+        // frames published in between may have been skipped,
+        // so the dirty rows are what changed since the last presented frame
+        Framebuffer::Packed_display presented { };
+        uint32_t dirty_rows = 0xFFFFFFFF;
+
+        while(renderer.is_running() && running.load(std::memory_order_relaxed))
+        {
+            {
+                Metrics::Scope scope(metrics, Metrics::Phase::EVENTS);
+                renderer.event_handler(input);
+            }
+
+            if(not frames.update())
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+
+            const Framebuffer::Packed_display& display = frames.read_buffer();
+            for(size_t y = 0; y < display.size(); y++)
+            {
+                if(display[y] != presented[y])
+                    dirty_rows |= 1u << y;
+            }
+
+            {
+                Metrics::Scope scope(metrics, Metrics::Phase::PRESENT);
+                renderer.update(display, dirty_rows);
+            }
+            presented  = display;
+            dirty_rows = 0;
+
+            end_frame(renderer, metrics, options.overlay);
         }
 
+        running.store(false, std::memory_order_relaxed);
+        emulation.join();
+    }
+
+    void run_single_thread(Chip8& chip, Renderer& renderer, const Options& options, Input_recorder* recorder, Metrics* metrics)
+    {
+        Scheduler scheduler(options.run.clock, options.turbo);
+
+        std::unique_ptr<Rewind_buffer> history;
+        if(options.rewind_seconds > 0)
+            history = std::make_unique<Rewind_buffer>(options.rewind_seconds * Scheduler::FRAME_RATE);
+
+        Input_queue input;
+        while(renderer.is_running() && has_frames_left(scheduler, options))
+        {
+            {
+                Metrics::Scope scope(metrics, Metrics::Phase::EVENTS);
+                renderer.event_handler(input);
+            }
+
+            input.drain(chip, recorder);
+
+            // one snapshot back per frame while rewinding, the keypad stays as it is now
+            if(history && renderer.is_rewinding())
+            {
+                const auto keypads = chip.keypads;
+                history->rewind(chip);
+                chip.keypads = keypads;
+            }
+            else
+            {
+                Metrics::Scope scope(metrics, Metrics::Phase::EMULATE);
+                const uint64_t executed = scheduler.run_frame(chip);
+
+                if(metrics)
+                    metrics->add_instructions(executed);
+
+                if(history)
+                    history->on_frame(chip);
+            }
+
+            {
+                Metrics::Scope scope(metrics, Metrics::Phase::PRESENT);
+                renderer.update(chip.display, chip.get_dirty_rows());
+                chip.clear_dirty_rows();
+            }
+
+            {
+                Metrics::Scope scope(metrics, Metrics::Phase::WAIT);
+
+                // the program can't move before the next key, frames would all be the same
+                if(chip.waits_for_input() && not (history && renderer.is_rewinding()))
+                    renderer.wait_event(IDLE_TIMEOUT_MS);
+
+                scheduler.wait_next_frame();
+            }
+
+            end_frame(renderer, metrics, options.overlay);
+        }
+    }
+
+    // nullptr when the build has no SDL
+    std::unique_ptr<Renderer> make_renderer(Output output)
+    {
+        switch(output)
+        {
+            case Output::TERMINAL:
+                return std::make_unique<Terminal_renderer>();
+            case Output::NONE:
+                return std::make_unique<Null_renderer>();
+            case Output::SDL:
+                break;
+        }
+
+        #if HEADLESS_ONLY
+        return nullptr;
+        #else
+        return std::make_unique<Window>("Chip8 Emulator", WINDOW_SIZE * CHIP8_WIDTH, WINDOW_SIZE * CHIP8_HEIGHT,
+                                        CHIP8_WIDTH, CHIP8_HEIGHT);
+        #endif // HEADLESS_ONLY
+    }
+
+    // keypad changes are recorded at frame boundaries, where a replay applies them again
+    int run_interactive(Chip8& chip, const Options& options)
+    {
+        // everything that can throw comes before the renderer takes over the screen
+        std::unique_ptr<Keymap> keymap;
+        if(not options.keymap_path.empty())
+            keymap = std::make_unique<Keymap>(options.keymap_path);
+
+        std::unique_ptr<Input_recorder> recorder;
+        if(not options.record_path.empty())
+            recorder = std::make_unique<Input_recorder>(options.record_path, chip.get_seed(), options.run.clock);
+
+        std::unique_ptr<Metrics> metrics;
+        if(not options.stats_path.empty() || options.overlay)
+            metrics = std::make_unique<Metrics>(options.stats_path);
+
+        const std::unique_ptr<Renderer> renderer = make_renderer(options.output);
+        if(not renderer)
+        {
+            std::cerr << "This build has no window, use --headless or --renderer terminal or null!\n";
+            return EXIT_FAILURE;
+        }
+
+        if(keymap)
+            renderer->set_keymap(*keymap);
+
+        // a machine without sound still runs
+        #if not HEADLESS_ONLY
+        std::unique_ptr<Audio_device> audio;
+        if(not options.mute && options.output != Output::NONE)
+        {
+            try
+            {
+                audio = std::make_unique<Audio_device>(static_cast<uint16_t>(options.audio_buffer));
+                chip.set_sound_flag(&audio->get_tone_flag());
+            }
+            catch(const std::exception& error)
+            {
+                std::cerr << error.what() << " Continuing without sound.\n";
+            }
+        }
+        #endif // not HEADLESS_ONLY
+
+        if(options.threaded)
+            run_threaded(chip, *renderer, options, recorder.get(), metrics.get());
+        else
+            run_single_thread(chip, *renderer, options, recorder.get(), metrics.get());
+
+        chip.set_sound_flag(nullptr);
+
+        if(recorder)
+            recorder->set_end(chip.get_cycles());
+
         return EXIT_SUCCESS;
     }
-    else
-        std::cerr << "Please specify a correct path!\n";
 
-    return EXIT_FAILURE;
+    int start(int argv, char* argc[])
+    {
+        // the program won't start without a path to the game
+        Options options;
+        if(not parse_options(argv, argc, options))
+        {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+
+        Chip8 chip(options.rom_path);
+
+        std::unique_ptr<Input_replay> replay;
+        if(not options.replay_path.empty())
+        {
+            replay = std::make_unique<Input_replay>(options.replay_path);
+            options.run.clock = replay->get_clock();
+
+            if(options.run.instructions == 0 && options.run.frames == 0)
+                options.run.instructions = replay->get_end_cycle();
+
+            chip.seed(replay->get_seed());
+        }
+        else if(options.has_seed)
+            chip.seed(options.seed);
+
+        // after seeding, the save state holds the generator as it was
+        if(not options.load_state_path.empty())
+            chip.load_state(options.load_state_path);
+
+        if(options.no_cache)
+            chip.set_decode_cache(false);
+        if(options.no_fusion)
+            chip.set_fusion(false);
+        if(options.jit)
+            chip.set_backend(Chip8::Backend::JIT);
+
+        std::unique_ptr<Tracer> tracer;
+        if(not options.trace_path.empty())
+        {
+            tracer = std::make_unique<Tracer>(options.trace_path);
+            chip.set_tracer(tracer.get());
+        }
+
+        #if ENABLE_PROFILER
+        std::unique_ptr<Profiler> profiler;
+        if(not options.profile_prefix.empty())
+        {
+            profiler = std::make_unique<Profiler>();
+            chip.set_profiler(profiler.get());
+        }
+        #endif // ENABLE_PROFILER
+
+        // the headless mode never touches SDL
+        if(options.headless)
+        {
+            std::unique_ptr<Wav_sink> wav;
+            if(not options.wav_path.empty())
+                wav = std::make_unique<Wav_sink>(options.wav_path);
+
+            std::unique_ptr<Capture> capture;
+            if(not options.capture_path.empty())
+                capture = std::make_unique<Capture>(options.capture_path, options.capture_format, options.keyframes,
+                                                    options.capture_path + ".");
+
+            const Headless_result result = run_headless(chip, options.run, replay.get(), wav.get(), capture.get());
+            print_state(std::cout, chip, result);
+
+            if(capture)
+                std::cout << "captured frames: " << capture->get_captured() << " of " << capture->get_frames()
+                          << " stalls: " << capture->get_stalls() << "\n";
+        }
+        else if(const int status = run_interactive(chip, options); status != EXIT_SUCCESS)
+            return status;
+
+        if(not options.save_state_path.empty())
+            chip.save_state(options.save_state_path);
+
+        #if ENABLE_PROFILER
+        if(profiler)
+        {
+            profiler->report(std::cout);
+
+            std::ofstream json(options.profile_prefix + ".json");
+            std::ofstream folded(options.profile_prefix + ".folded");
+            if(not json.is_open() || not folded.is_open())
+                throw std::runtime_error("Profile path is invalid!");
+
+            profiler->write_json(json);
+            profiler->write_folded(folded);
+        }
+        #endif // ENABLE_PROFILER
+
+        return EXIT_SUCCESS;
+    }
+}
+
+
+int main(int argv, char* argc[])
+{
+    // unwinding restores the terminal a renderer took over
+    try
+    {
+        return start(argv, argc);
+    }
+    catch(const std::exception& error)
+    {
+        std::cerr << error.what() << "\n";
+        return EXIT_FAILURE;
+    }
 }
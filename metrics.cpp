@@ -0,0 +1,111 @@
+#include "metrics.hpp"
+
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <stdexcept>
+
+namespace
+{
+    const char* const PHASE_NAMES[Metrics::PHASE_COUNT] {
+        "emulate",
+        "events",
+        "present",
+        "wait"
+    };
+}
+
+Metrics::Metrics(const std::string& stats_path, Clock::duration period)
+    : stats_path(stats_path),
+      period(period),
+      period_start(Clock::now()),
+      last_frame(period_start)
+{
+    if(period <= Clock::duration::zero())
+        throw std::invalid_argument("Metrics period must be longer than 0!");
+
+    if(not stats_path.empty() && not std::ofstream(stats_path).is_open())
+        throw std::invalid_argument("Stats path is invalid!");
+}
+
+bool Metrics::end_frame()
+{
+    const Clock::time_point now = Clock::now();
+    const uint64_t frame_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_frame).count();
+    last_frame = now;
+
+    const size_t bucket = frame_ns / BUCKET_NANOSECONDS;
+    buckets[bucket < BUCKET_COUNT ? bucket : BUCKET_COUNT - 1]++;
+    frames++;
+
+    if(frame_ns > max_frame_ns)
+        max_frame_ns = frame_ns;
+
+    if(now - period_start < period)
+        return false;
+
+    const double seconds = std::chrono::duration<double>(now - period_start).count();
+
+    snapshot.seconds                 = seconds;
+    snapshot.frames                  = frames;
+    snapshot.instructions_per_second = instructions_count.exchange(0, std::memory_order_relaxed) / seconds;
+    snapshot.frame_p50_ms            = percentile(0.50);
+    snapshot.frame_p99_ms            = percentile(0.99);
+    snapshot.frame_max_ms            = max_frame_ns / 1e6;
+
+    for(size_t i = 0; i < PHASE_COUNT; i++)
+        snapshot.phase_share[i] = phase_nanoseconds[i].exchange(0, std::memory_order_relaxed) / 1e9 / seconds;
+
+    buckets.fill(0);
+    frames       = 0;
+    max_frame_ns = 0;
+    period_start = now;
+
+    if(not stats_path.empty())
+        publish();
+
+    return true;
+}
+
+// the upper edge of the bucket holding the frame at `fraction` of the sorted frame times
+double Metrics::percentile(double fraction) const noexcept
+{
+    const uint64_t rank = static_cast<uint64_t>(fraction * (frames - 1)) + 1;
+
+    uint64_t seen = 0;
+    for(size_t i = 0; i < BUCKET_COUNT; i++)
+    {
+        seen += buckets[i];
+        if(seen >= rank)
+            return (i + 1) * BUCKET_NANOSECONDS / 1e6;
+    }
+
+    return BUCKET_COUNT * BUCKET_NANOSECONDS / 1e6;
+}
+
+// written next to the stats file and renamed over it,
+// a reader never sees half a snapshot
+void Metrics::publish() const
+{
+    const std::string temporary = stats_path + ".tmp";
+    {
+        std::ofstream out(temporary);
+        if(not out.is_open())
+            return;
+
+        out << "{ \"seconds\": " << snapshot.seconds
+            << ", \"frames\": " << snapshot.frames
+            << ", \"instructions_per_second\": " << snapshot.instructions_per_second
+            << ", \"frame_p50_ms\": " << snapshot.frame_p50_ms
+            << ", \"frame_p99_ms\": " << snapshot.frame_p99_ms
+            << ", \"frame_max_ms\": " << snapshot.frame_max_ms
+            << ", \"phase_share\": { ";
+
+        for(size_t i = 0; i < PHASE_COUNT; i++)
+            out << (i > 0 ? ", " : "") << "\"" << PHASE_NAMES[i] << "\": " << snapshot.phase_share[i];
+
+        out << " } }\n";
+    }
+
+    std::rename(temporary.c_str(), stats_path.c_str());
+}
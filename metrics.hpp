@@ -0,0 +1,109 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Counts emulated instructions and host time per phase of the main loop,
+// and keeps a histogram of frame times. Every period the counters are turned
+// into a snapshot, written to the stats file when there is one, and reset.
+// Instructions and phase times may be added from any thread, frames are ended
+// and snapshots read by a single thread.
+class Metrics
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Where the host spends a frame
+    enum class Phase : uint8_t
+    {
+        EMULATE, // running the instructions of the frame
+        EVENTS,  // polling the window and the keypad
+        PRESENT, // uploading and presenting the display
+        WAIT,    // sleeping until the next frame
+        COUNT
+    };
+
+    static constexpr size_t PHASE_COUNT = static_cast<size_t>(Phase::COUNT);
+
+    struct Snapshot
+    {
+        double   seconds                 = 0; // length of the period
+        uint64_t frames                  = 0;
+        double   instructions_per_second = 0;
+        double   frame_p50_ms            = 0;
+        double   frame_p99_ms            = 0;
+        double   frame_max_ms            = 0;
+
+        // share of the period spent in each phase, phases
+        // timed on different threads can add up to more than 1
+        std::array<double, PHASE_COUNT> phase_share { };
+    };
+
+    // Times a phase from construction to destruction, does nothing without metrics
+    class Scope
+    {
+    public:
+        Scope(Metrics* metrics, Phase phase) noexcept
+            : metrics(metrics), phase(phase), start(metrics ? Clock::now() : Clock::time_point { }) { }
+
+        ~Scope() { if(metrics) metrics->add_time(phase, Clock::now() - start); }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Metrics*          metrics;
+        Phase             phase;
+        Clock::time_point start;
+    };
+
+    // nothing is written when `stats_path` is empty,
+    // throws when the stats file can't be created or the period is 0
+    explicit Metrics(const std::string& stats_path = { }, Clock::duration period = std::chrono::seconds(1));
+
+    void add_instructions(uint64_t instructions) noexcept {
+        instructions_count.fetch_add(instructions, std::memory_order_relaxed);
+    }
+
+    void add_time(Phase phase, Clock::duration time) noexcept {
+        phase_nanoseconds[static_cast<size_t>(phase)].fetch_add(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(time).count(), std::memory_order_relaxed);
+    }
+
+    // the time since the last call goes into the histogram,
+    // returns true when the period ended and a new snapshot was taken
+    bool end_frame();
+
+    // the snapshot of the last complete period
+    const Snapshot& get_snapshot() const noexcept { return snapshot; }
+
+private:
+    // frame times in 50us buckets up to 100ms, longer frames go to the last bucket
+    static constexpr uint64_t BUCKET_NANOSECONDS = 50'000;
+    static constexpr size_t   BUCKET_COUNT       = 2000 + 1;
+
+    double percentile(double fraction) const noexcept;
+    void publish() const;
+
+    std::string     stats_path;
+    Clock::duration period;
+
+    std::atomic<uint64_t> instructions_count { 0 };
+    std::array<std::atomic<uint64_t>, PHASE_COUNT> phase_nanoseconds { };
+
+    Clock::time_point period_start;
+    Clock::time_point last_frame;
+
+    std::array<uint32_t, BUCKET_COUNT> buckets { };
+    uint64_t frames       = 0;
+    uint64_t max_frame_ns = 0;
+
+    Snapshot snapshot;
+};
+
+#endif // METRICS_HPP
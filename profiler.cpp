@@ -0,0 +1,159 @@
+#include "profiler.hpp"
+
+#if ENABLE_PROFILER
+
+#include <algorithm>
+#include <exception>
+#include <iomanip>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+    double percent(uint64_t part, uint64_t total) noexcept
+    {
+        return total > 0 ? 100.0 * part / total : 0;
+    }
+}
+
+Profiler::Profiler(uint32_t sample_interval)
+    : sample_interval(sample_interval),
+      countdown(sample_interval)
+{
+    if(sample_interval == 0)
+        throw std::invalid_argument("Sample interval must be at least 1 instruction!");
+}
+
+uint64_t Profiler::get_instructions() const noexcept
+{
+    return std::accumulate(category_counts.begin(), category_counts.end(), uint64_t { 0 });
+}
+
+const char* Profiler::get_category_name(Category category) noexcept
+{
+    static constexpr const char* names[] {
+        "other",
+        "draw",
+        "timer wait",
+        "key wait"
+    };
+
+    return names[static_cast<size_t>(category)];
+}
+
+void Profiler::report(std::ostream& out, size_t top) const
+{
+    const uint64_t instructions = get_instructions();
+    const uint64_t total_ticks  = std::accumulate(category_ticks.begin(), category_ticks.end(), uint64_t { 0 });
+
+    out << std::fixed << std::setprecision(1);
+    out << "profiled instructions: " << instructions << ", 1 in " << sample_interval << " timed\n";
+
+    out << "time split:\n";
+    for(size_t i = 0; i < CATEGORY_COUNT; i++)
+    {
+        out << "  " << std::left << std::setw(12) << get_category_name(static_cast<Category>(i)) << std::right
+            << std::setw(6) << percent(category_ticks[i], total_ticks) << "% of time, "
+            << std::setw(6) << percent(category_counts[i], instructions) << "% of instructions\n";
+    }
+
+    out << "instructions:\n";
+    std::vector<size_t> classes(class_counts.size());
+    std::iota(classes.begin(), classes.end(), 0);
+    std::stable_sort(classes.begin(), classes.end(), [this](size_t a, size_t b) { return class_counts[a] > class_counts[b]; });
+
+    for(size_t opcode_class : classes)
+    {
+        if(class_counts[opcode_class] == 0)
+            break;
+
+        out << "  " << std::left << std::setw(8) << Chip8::get_opcode_name(opcode_class) << std::right
+            << std::setw(14) << class_counts[opcode_class]
+            << std::setw(7) << percent(class_counts[opcode_class], instructions) << "%\n";
+    }
+
+    out << "hot addresses:\n";
+    std::vector<uint16_t> addresses;
+    for(size_t address = 0; address < ADDRESS_COUNT; address++)
+    {
+        if(address_counts[address] > 0)
+            addresses.push_back(static_cast<uint16_t>(address));
+    }
+
+    const size_t shown = std::min(top, addresses.size());
+    std::partial_sort(addresses.begin(), addresses.begin() + shown, addresses.end(),
+                      [this](uint16_t a, uint16_t b) { return address_counts[a] > address_counts[b]; });
+
+    for(size_t i = 0; i < shown; i++)
+    {
+        const uint16_t address = addresses[i];
+
+        out << "  0x" << std::hex << std::setfill('0') << std::setw(3) << address << std::dec << std::setfill(' ')
+            << "  " << std::left << std::setw(8) << Chip8::get_opcode_name(address_classes[address]) << std::right
+            << std::setw(14) << address_counts[address]
+            << std::setw(7) << percent(address_counts[address], instructions) << "%\n";
+    }
+
+    out << std::defaultfloat;
+}
+
+void Profiler::write_json(std::ostream& out) const
+{
+    out << "{\n  \"instructions\": " << get_instructions()
+        << ",\n  \"sample_interval\": " << sample_interval
+        << ",\n  \"categories\": {";
+
+    for(size_t i = 0; i < CATEGORY_COUNT; i++)
+    {
+        out << (i > 0 ? "," : "") << "\n    \"" << get_category_name(static_cast<Category>(i)) << "\": { "
+            << "\"instructions\": " << category_counts[i]
+            << ", \"samples\": " << category_samples[i]
+            << ", \"ticks\": " << category_ticks[i] << " }";
+    }
+
+    out << "\n  },\n  \"classes\": {";
+
+    bool first = true;
+    for(size_t i = 0; i < class_counts.size(); i++)
+    {
+        if(class_counts[i] == 0)
+            continue;
+
+        out << (first ? "" : ",") << "\n    \"" << Chip8::get_opcode_name(i) << "\": " << class_counts[i];
+        first = false;
+    }
+
+    out << "\n  },\n  \"addresses\": [";
+
+    first = true;
+    for(size_t address = 0; address < ADDRESS_COUNT; address++)
+    {
+        if(address_counts[address] == 0)
+            continue;
+
+        out << (first ? "" : ",") << "\n    { \"address\": " << address
+            << ", \"class\": \"" << Chip8::get_opcode_name(address_classes[address])
+            << "\", \"category\": \"" << get_category_name(static_cast<Category>(address_categories[address]))
+            << "\", \"count\": " << address_counts[address] << " }";
+        first = false;
+    }
+
+    out << "\n  ]\n}\n";
+}
+
+void Profiler::write_folded(std::ostream& out) const
+{
+    for(size_t address = 0; address < ADDRESS_COUNT; address++)
+    {
+        if(address_counts[address] == 0)
+            continue;
+
+        out << "chip8;" << get_category_name(static_cast<Category>(address_categories[address]))
+            << ";" << Chip8::get_opcode_name(address_classes[address])
+            << ";0x" << std::hex << std::setfill('0') << std::setw(3) << address << std::dec << std::setfill(' ')
+            << " " << address_counts[address] << "\n";
+    }
+}
+
+#endif // ENABLE_PROFILER
@@ -0,0 +1,124 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#if ENABLE_PROFILER
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+#include "chip8.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+// Counts every instruction executed per instruction class and per address,
+// and times one instruction out of every `sample_interval` to split the time
+// between drawing, polling the delay timer and waiting for a key.
+// A machine only runs through the profiler while one is attached to it.
+class Profiler
+{
+public:
+    // What the program was busy with when it executed an instruction
+    enum class Category : uint8_t
+    {
+        OTHER,
+        DRAW,       // 00E0, DXYN
+        TIMER_WAIT, // FX07 and the 3XKK, 4XKK or 1NNN polling it
+        KEY_WAIT,   // FX0A, executed again until a key is pressed
+        COUNT
+    };
+
+    enum { DEFAULT_SAMPLE_INTERVAL = 64 };
+
+    // throws when the interval is 0
+    explicit Profiler(uint32_t sample_interval = DEFAULT_SAMPLE_INTERVAL);
+
+    // true once every `sample_interval` instructions
+    bool sample_next() noexcept
+    {
+        if(--countdown != 0)
+            return false;
+
+        countdown = sample_interval;
+        return true;
+    }
+
+    void record(uint16_t address, uint8_t opcode_class, Category category) noexcept
+    {
+        // everything past the memory shares the last slot
+        address = std::min<uint16_t>(address, MEMORY_SIZE);
+
+        address_counts[address]++;
+        address_classes[address]    = opcode_class;
+        address_categories[address] = static_cast<uint8_t>(category);
+        class_counts[opcode_class]++;
+        category_counts[static_cast<size_t>(category)]++;
+    }
+
+    void record_sample(Category category, uint64_t elapsed) noexcept
+    {
+        category_ticks[static_cast<size_t>(category)] += elapsed;
+        category_samples[static_cast<size_t>(category)]++;
+    }
+
+    // a cycle counter where there is one, nanoseconds otherwise
+    static uint64_t ticks() noexcept
+    {
+        #if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+        #else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        #endif
+    }
+
+    uint64_t get_instructions() const noexcept;
+    constexpr uint32_t get_sample_interval() const noexcept { return sample_interval; }
+
+    uint64_t get_address_count(uint16_t address) const noexcept { return address_counts[std::min<uint16_t>(address, MEMORY_SIZE)]; }
+    uint64_t get_class_count(size_t opcode_class) const noexcept { return class_counts[opcode_class]; }
+    uint64_t get_category_count(Category category) const noexcept { return category_counts[static_cast<size_t>(category)]; }
+    uint64_t get_category_ticks(Category category) const noexcept { return category_ticks[static_cast<size_t>(category)]; }
+
+    static const char* get_category_name(Category category) noexcept;
+
+    // the time split, the instruction classes and the `top` hottest addresses
+    void report(std::ostream& out, size_t top = 20) const;
+
+    // every counter, addresses that never ran are left out
+    void write_json(std::ostream& out) const;
+
+    // one "chip8;category;class;address count" line per address,
+    // the input of flamegraph.pl and speedscope
+    void write_folded(std::ostream& out) const;
+
+private:
+    // one slot per byte of memory and one for a pc that left it
+    static constexpr size_t ADDRESS_COUNT = MEMORY_SIZE + 1;
+    static constexpr size_t CATEGORY_COUNT = static_cast<size_t>(Category::COUNT);
+
+    uint32_t sample_interval;
+    uint32_t countdown;
+
+    std::array<uint64_t, ADDRESS_COUNT> address_counts { };
+
+    // the last class and category seen at each address, the program may have changed since
+    std::array<uint8_t, ADDRESS_COUNT> address_classes    { };
+    std::array<uint8_t, ADDRESS_COUNT> address_categories { };
+
+    std::array<uint64_t, Chip8::OPCODE_CLASS_COUNT> class_counts { };
+
+    std::array<uint64_t, CATEGORY_COUNT> category_counts  { };
+    std::array<uint64_t, CATEGORY_COUNT> category_ticks   { };
+    std::array<uint64_t, CATEGORY_COUNT> category_samples { };
+};
+
+#endif // ENABLE_PROFILER
+
+#endif // PROFILER_HPP
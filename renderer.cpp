@@ -0,0 +1,43 @@
+#include "renderer.hpp"
+
+#include <csignal>
+
+namespace
+{
+    volatile std::sig_atomic_t interrupted = 0;
+
+    void on_interrupt(int) {
+        interrupted = 1;
+    }
+}
+
+void catch_interrupt() noexcept
+{
+    std::signal(SIGINT, on_interrupt);
+    std::signal(SIGTERM, on_interrupt);
+}
+
+bool was_interrupted() noexcept {
+    return interrupted != 0;
+}
+
+Null_renderer::Null_renderer() noexcept
+{
+    catch_interrupt();
+}
+
+void Null_renderer::update(const Framebuffer::Packed_display& display, uint32_t dirty_rows) noexcept
+{
+    (void)display;
+    (void)dirty_rows;
+}
+
+// nothing can arrive, the frame pacing waits anyway
+void Null_renderer::wait_event(int timeout_ms) noexcept
+{
+    (void)timeout_ms;
+}
+
+bool Null_renderer::is_running() const noexcept {
+    return not was_interrupted();
+}
@@ -0,0 +1,52 @@
+#ifndef RENDERER_HPP
+#define RENDERER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "framebuffer.hpp"
+#include "input.hpp"
+
+// What the frontend presents to and takes input from, picked at runtime
+// with --renderer. The window, the terminal and the null output implement it.
+class Renderer
+{
+public:
+    virtual ~Renderer() = default;
+
+    // keypad transitions go to `input` through the keymap
+    virtual void event_handler(Input_queue& input) noexcept = 0;
+
+    // only the rows set in `dirty_rows` changed since the last call
+    virtual void update(const Framebuffer::Packed_display& display, uint32_t dirty_rows) noexcept = 0;
+
+    // block until input arrives or `timeout_ms` passed,
+    // the input is left for event_handler()
+    virtual void wait_event(int timeout_ms) noexcept = 0;
+
+    virtual bool is_running() const noexcept = 0;
+    virtual bool is_rewinding() const noexcept { return false; }
+
+    virtual void set_keymap(const Keymap& map) noexcept { (void)map; }
+
+    // bars over the display, one per value in [0, 1], only drawn where there's room for them
+    virtual void set_overlay(const float* values, size_t count) noexcept { (void)values; (void)count; }
+};
+
+// Shows nothing and reads nothing, runs until SIGINT or the frame budget
+class Null_renderer final : public Renderer
+{
+public:
+    Null_renderer() noexcept;
+
+    void event_handler(Input_queue& input) noexcept override { (void)input; }
+    void update(const Framebuffer::Packed_display& display, uint32_t dirty_rows) noexcept override;
+    void wait_event(int timeout_ms) noexcept override;
+    bool is_running() const noexcept override;
+};
+
+// SIGINT stops the renderers that can't see a key for it
+void catch_interrupt() noexcept;
+bool was_interrupted() noexcept;
+
+#endif // RENDERER_HPP
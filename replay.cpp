@@ -0,0 +1,86 @@
+#include "replay.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+#include "byte_order.hpp"
+
+namespace
+{
+    constexpr char MAGIC[4] = { 'C', '8', 'I', 'R' };
+}
+
+Input_recorder::Input_recorder(const std::string& path, uint64_t seed, uint64_t clock)
+    : file(path, std::ofstream::binary | std::ofstream::out)
+{
+    if(not file.is_open())
+        throw std::invalid_argument("Recording path is invalid!");
+
+    file.write(MAGIC, sizeof(MAGIC));
+    write_le<uint16_t>(file, VERSION);
+    write_le<uint64_t>(file, seed);
+    write_le<uint64_t>(file, clock);
+}
+
+Input_recorder::~Input_recorder()
+{
+    write_event({ end_cycle, END_KEY, 0 });
+}
+
+void Input_recorder::record(const Input_event& event)
+{
+    write_event(event);
+    end_cycle = event.cycle;
+}
+
+void Input_recorder::write_event(const Input_event& event)
+{
+    write_le(file, event.cycle);
+    write_le(file, event.key);
+    write_le(file, event.pressed);
+}
+
+Input_replay::Input_replay(const std::string& path)
+{
+    std::ifstream file(path, std::ifstream::binary | std::ifstream::in);
+    if(not file.is_open())
+        throw std::invalid_argument("Replay path is invalid!");
+
+    char magic[sizeof(MAGIC)] { };
+    file.read(magic, sizeof(magic));
+
+    uint16_t version = 0;
+    if(not file || not std::equal(magic, magic + sizeof(magic), MAGIC) ||
+       not read_le(file, version) || version != Input_recorder::VERSION)
+        throw std::runtime_error("File is not an input recording!");
+
+    if(not read_le(file, seed) || not read_le(file, clock))
+        throw std::runtime_error("Input recording is truncated!");
+
+    Input_event event;
+    while(read_le(file, event.cycle))
+    {
+        if(not read_le(file, event.key) || not read_le(file, event.pressed))
+            throw std::runtime_error("Input recording is truncated!");
+
+        if(event.key == Input_recorder::END_KEY)
+        {
+            end_cycle = event.cycle;
+            return;
+        }
+
+        if(event.key >= KEYPADS_SIZE)
+            throw std::runtime_error("Input recording has an invalid key!");
+
+        events.push_back(event);
+    }
+
+    throw std::runtime_error("Input recording has no end!");
+}
+
+void Input_replay::apply(Chip8& chip) noexcept
+{
+    for(; next < events.size() && events[next].cycle <= chip.get_cycles(); next++)
+        chip.keypads[events[next].key] = events[next].pressed;
+}
@@ -0,0 +1,75 @@
+#ifndef REPLAY_HPP
+#define REPLAY_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "chip8.hpp"
+
+// Input recordings are little-endian:
+// "C8IR", uint16 version, uint64 seed, uint64 clock,
+// then one record per keypad transition: uint64 cycle, uint8 key, uint8 pressed.
+// The last record uses END_KEY and holds the cycle the recording stopped at.
+struct Input_event
+{
+    uint64_t cycle;
+    uint8_t  key;
+    uint8_t  pressed;
+};
+
+class Input_recorder
+{
+public:
+    enum
+    {
+        VERSION = 1,
+        END_KEY = 0xFF
+    };
+
+    // throws when the file can't be created
+    Input_recorder(const std::string& path, uint64_t seed, uint64_t clock);
+
+    // writes the end record
+    ~Input_recorder();
+
+    Input_recorder(const Input_recorder&) = delete;
+    Input_recorder& operator=(const Input_recorder&) = delete;
+
+    // record one transition as it is
+    void record(const Input_event& event);
+
+    // remember where the recording stops, written by the destructor
+    constexpr void set_end(uint64_t cycle) noexcept { end_cycle = cycle; }
+
+private:
+    void write_event(const Input_event& event);
+
+    std::ofstream file;
+    uint64_t      end_cycle = 0;
+};
+
+class Input_replay
+{
+public:
+    // throws when the file is missing, isn't a recording or is truncated
+    explicit Input_replay(const std::string& path);
+
+    constexpr uint64_t get_seed() const noexcept { return seed; }
+    constexpr uint64_t get_clock() const noexcept { return clock; }
+    constexpr uint64_t get_end_cycle() const noexcept { return end_cycle; }
+
+    // press and release every key recorded up to the current cycle of `chip`
+    void apply(Chip8& chip) noexcept;
+
+private:
+    uint64_t seed      = 0;
+    uint64_t clock     = 0;
+    uint64_t end_cycle = 0;
+
+    std::vector<Input_event> events;
+    size_t                   next = 0;
+};
+
+#endif // REPLAY_HPP
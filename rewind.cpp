@@ -0,0 +1,146 @@
+#include "rewind.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+
+namespace
+{
+    void put_varint(std::vector<uint8_t>& out, size_t value)
+    {
+        while(value >= 0x80)
+        {
+            out.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    size_t get_varint(const uint8_t*& in) noexcept
+    {
+        size_t value = 0;
+        for(int shift = 0; ; shift += 7)
+        {
+            const uint8_t byte = *in++;
+            value |= static_cast<size_t>(byte & 0x7F) << shift;
+
+            if((byte & 0x80) == 0)
+                return value;
+        }
+    }
+}
+
+Rewind_buffer::Rewind_buffer(size_t capacity, uint32_t interval)
+    : capacity(capacity), interval(interval)
+{
+    if(capacity == 0 || interval == 0)
+        throw std::invalid_argument("Rewind buffer needs a capacity and an interval!");
+
+    // the newest snapshot is stored whole
+    deltas.resize(capacity - 1);
+}
+
+void Rewind_buffer::on_frame(const Chip8& chip)
+{
+    if(++frames < interval)
+        return;
+
+    frames = 0;
+    push(chip);
+}
+
+void Rewind_buffer::push(const Chip8& chip)
+{
+    chip.save_state(scratch);
+
+    if(count > 0 && not deltas.empty())
+    {
+        // the delta goes backwards, from the new snapshot to the one before
+        encode_delta(scratch, newest, deltas[head]);
+        head = (head + 1) % deltas.size();
+    }
+
+    newest = scratch;
+    count  = std::min(count + 1, capacity);
+}
+
+bool Rewind_buffer::rewind(Chip8& chip) noexcept
+{
+    if(count == 0)
+        return false;
+
+    chip.load_state(newest);
+    count--;
+
+    // the snapshot before becomes the newest one
+    if(count > 0)
+    {
+        head = (head + deltas.size() - 1) % deltas.size();
+        apply_delta(deltas[head], newest);
+    }
+
+    frames = 0;
+    return true;
+}
+
+void Rewind_buffer::clear() noexcept
+{
+    head   = 0;
+    count  = 0;
+    frames = 0;
+}
+
+size_t Rewind_buffer::get_delta_bytes() const noexcept
+{
+    size_t bytes = 0;
+    for(size_t i = 1; i < count; i++)
+        bytes += deltas[(head + deltas.size() - i) % deltas.size()].size();
+
+    return bytes;
+}
+
+// A delta is a list of (zero run, literal length, literal bytes),
+// the literal bytes are the XOR of both states
+void Rewind_buffer::encode_delta(const Chip8::State& from, const Chip8::State& to, std::vector<uint8_t>& out)
+{
+    out.clear();
+
+    size_t i = 0;
+    while(i < from.size())
+    {
+        // skip equal bytes a word at a time first
+        const size_t run_start = i;
+        while(i + 8 <= from.size() && std::memcmp(&from[i], &to[i], 8) == 0)
+            i += 8;
+        while(i < from.size() && from[i] == to[i])
+            i++;
+
+        const size_t literal_start = i;
+        while(i < from.size() && from[i] != to[i])
+            i++;
+
+        put_varint(out, literal_start - run_start);
+        put_varint(out, i - literal_start);
+
+        for(size_t j = literal_start; j < i; j++)
+            out.push_back(from[j] ^ to[j]);
+    }
+}
+
+void Rewind_buffer::apply_delta(const std::vector<uint8_t>& delta, Chip8::State& state) noexcept
+{
+    const uint8_t* in  = delta.data();
+    const uint8_t* end = delta.data() + delta.size();
+
+    size_t i = 0;
+    while(in < end)
+    {
+        i += get_varint(in);
+
+        const size_t literal = get_varint(in);
+        for(size_t j = 0; j < literal; j++)
+            state[i++] ^= *in++;
+    }
+}
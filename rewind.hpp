@@ -0,0 +1,55 @@
+#ifndef REWIND_HPP
+#define REWIND_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "chip8.hpp"
+
+// Keeps the last snapshots of a machine to step back through them.
+// Only the newest snapshot is stored whole, every older one is the XOR
+// against the snapshot after it, with the runs of zeros compressed away.
+class Rewind_buffer
+{
+public:
+    // throws when capacity or interval is 0
+    Rewind_buffer(size_t capacity, uint32_t interval = 1);
+
+    // call once per frame, takes a snapshot every `interval` frames
+    void on_frame(const Chip8& chip);
+
+    // snapshot the machine now, the oldest snapshot is dropped when full
+    void push(const Chip8& chip);
+
+    // load the newest snapshot into `chip` and forget it,
+    // returns false when there is nothing left to go back to
+    bool rewind(Chip8& chip) noexcept;
+
+    void clear() noexcept;
+
+    constexpr size_t size() const noexcept { return count; }
+    constexpr size_t get_capacity() const noexcept { return capacity; }
+
+    // bytes held by the snapshots, not counting the newest one
+    size_t get_delta_bytes() const noexcept;
+
+private:
+    static void encode_delta(const Chip8::State& from, const Chip8::State& to, std::vector<uint8_t>& out);
+    static void apply_delta(const std::vector<uint8_t>& delta, Chip8::State& state) noexcept;
+
+    size_t   capacity;
+    uint32_t interval;
+    uint32_t frames = 0;
+
+    Chip8::State newest  { };
+    Chip8::State scratch { };
+
+    // ring of deltas, the one at `head - 1` turns `newest` into the snapshot before it,
+    // the vectors keep their capacity so a full ring doesn't allocate anymore
+    std::vector<std::vector<uint8_t>> deltas;
+    size_t head  = 0;
+    size_t count = 0;
+};
+
+#endif // REWIND_HPP
@@ -0,0 +1,107 @@
+#ifndef RING_WRITER_HPP
+#define RING_WRITER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "spsc_queue.hpp"
+
+// A ring from one producer thread to a thread of its own that drains it in
+// batches, so the producer never waits on the work done with the values,
+// only on a ring that is full.
+template<typename T, size_t CAPACITY>
+class Ring_writer
+{
+public:
+    // run on the writer thread: Write with every batch drained,
+    // the idle call whenever the ring ran dry and the finish call after the last batch
+    using Write  = std::function<void(const T* values, size_t count)>;
+    using Notify = std::function<void()>;
+
+    Ring_writer() = default;
+
+    // drains what is left and joins the writer
+    ~Ring_writer() { stop(); }
+
+    Ring_writer(const Ring_writer&) = delete;
+    Ring_writer& operator=(const Ring_writer&) = delete;
+
+    // start the writer thread, at most `batch_size` values are drained at once
+    void start(size_t batch_size, Write write, Notify idle = nullptr, Notify finish = nullptr)
+    {
+        running.store(true, std::memory_order_relaxed);
+        writer = std::thread(&Ring_writer::write_loop, this, batch_size,
+                             std::move(write), std::move(idle), std::move(finish));
+    }
+
+    // everything pushed before is written once this returns
+    void stop()
+    {
+        if(not writer.joinable())
+            return;
+
+        running.store(false, std::memory_order_release);
+        writer.join();
+    }
+
+    // only called from the producer thread,
+    // waits for the writer when the ring is full so no value is lost
+    void push(const T& value) noexcept
+    {
+        if(not ring.try_push(value))
+            push_slow(value);
+    }
+
+    // how many times push() found the ring full
+    uint64_t get_stalls() const noexcept { return stalls; }
+
+private:
+    void push_slow(const T& value) noexcept
+    {
+        stalls++;
+        while(not ring.try_push(value))
+            std::this_thread::yield();
+    }
+
+    void write_loop(size_t batch_size, Write write, Notify idle, Notify finish)
+    {
+        std::vector<T> batch(batch_size);
+
+        for(;;)
+        {
+            // the flag is read before draining so nothing pushed before the stop is left behind
+            const bool stopping = not running.load(std::memory_order_acquire);
+            const size_t count  = ring.pop(batch.data(), batch.size());
+
+            if(count > 0)
+                write(batch.data(), count);
+            else if(stopping)
+                break;
+            else
+            {
+                if(idle)
+                    idle();
+
+                std::this_thread::sleep_for(std::chrono::microseconds(500));
+            }
+        }
+
+        if(finish)
+            finish();
+    }
+
+    uint64_t stalls = 0;
+
+    Spsc_queue<T, CAPACITY> ring;
+
+    std::atomic<bool> running { false };
+    std::thread       writer;
+};
+
+#endif // RING_WRITER_HPP
@@ -0,0 +1,58 @@
+#include "rom.hpp"
+
+#include <exception>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#if CHIP8_MMAP_SUPPORTED
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // CHIP8_MMAP_SUPPORTED
+
+Rom_file::Rom_file(const std::string& path)
+{
+    #if CHIP8_MMAP_SUPPORTED
+    const int file = open(path.c_str(), O_RDONLY);
+    if(file < 0)
+        throw std::invalid_argument("Path is invalid!");
+
+    struct stat info;
+    if(fstat(file, &info) == 0 && S_ISREG(info.st_mode))
+    {
+        length = static_cast<size_t>(info.st_size);
+
+        // an empty file can't be mapped and doesn't need to be
+        void* mapping = length > 0 ? mmap(nullptr, length, PROT_READ, MAP_PRIVATE, file, 0) : MAP_FAILED;
+        if(mapping != MAP_FAILED)
+        {
+            bytes  = static_cast<const uint8_t*>(mapping);
+            mapped = true;
+        }
+    }
+
+    close(file);
+
+    if(mapped)
+        return;
+    #endif // CHIP8_MMAP_SUPPORTED
+
+    std::ifstream file_stream(path, std::ifstream::binary | std::ifstream::in);
+    if(not file_stream.is_open())
+        throw std::invalid_argument("Path is invalid!");
+
+    buffer.assign(std::istreambuf_iterator<char>(file_stream), std::istreambuf_iterator<char>());
+
+    bytes  = buffer.data();
+    length = buffer.size();
+}
+
+Rom_file::~Rom_file()
+{
+    #if CHIP8_MMAP_SUPPORTED
+    if(mapped)
+        munmap(const_cast<uint8_t*>(bytes), length);
+    #endif // CHIP8_MMAP_SUPPORTED
+}
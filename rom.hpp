@@ -0,0 +1,38 @@
+#ifndef ROM_HPP
+#define ROM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// files are mapped where the platform allows it and read otherwise
+#if defined(__unix__) || defined(__APPLE__)
+#define CHIP8_MMAP_SUPPORTED 1
+#else
+#define CHIP8_MMAP_SUPPORTED 0
+#endif
+
+// Read-only bytes of a ROM file, shared by every machine built from it
+class Rom_file
+{
+public:
+    // throws when the file can't be opened
+    explicit Rom_file(const std::string& path);
+    ~Rom_file();
+
+    Rom_file(const Rom_file&) = delete;
+    Rom_file& operator=(const Rom_file&) = delete;
+
+    constexpr const uint8_t* data() const noexcept { return bytes; }
+    constexpr size_t size() const noexcept { return length; }
+
+private:
+    const uint8_t* bytes  = nullptr;
+    size_t         length = 0;
+    bool           mapped = false;
+
+    std::vector<uint8_t> buffer;
+};
+
+#endif // ROM_HPP
@@ -0,0 +1,97 @@
+#include "scheduler.hpp"
+
+#include <exception>
+#include <stdexcept>
+#include <thread>
+
+namespace
+{
+    // sleeping may overshoot, the last part of the wait is spent spinning
+    constexpr auto SPIN_TIME = std::chrono::microseconds(1000);
+
+    // further behind than this and the scheduler gives up catching up
+    constexpr uint64_t MAX_LAG_FRAMES = 5;
+
+    constexpr uint64_t NANOSECONDS_PER_SECOND = 1'000'000'000;
+}
+
+Scheduler::Scheduler(uint64_t clock, bool turbo)
+    : turbo(turbo)
+{
+    set_clock(clock);
+    resync();
+}
+
+uint64_t Scheduler::next_frame_instructions() const noexcept
+{
+    // spread the remainder of clock / 60 over every 60 frames
+    const uint64_t base      = clock / FRAME_RATE;
+    const uint64_t remainder = clock % FRAME_RATE;
+    const uint64_t frame     = frames % FRAME_RATE;
+
+    return base + ((frame + 1) * remainder) / FRAME_RATE - (frame * remainder) / FRAME_RATE;
+}
+
+uint64_t Scheduler::run_frame(Chip8& chip, uint64_t limit) noexcept
+{
+    const uint64_t instructions = next_frame_instructions();
+
+    // a frame cut short by the limit doesn't count and doesn't tick the timers
+    if(limit < instructions)
+        return chip.run(limit);
+
+    const uint64_t executed = chip.run(instructions);
+
+    chip.tick_timers();
+    frames++;
+
+    return executed;
+}
+
+void Scheduler::wait_next_frame() noexcept
+{
+    if(turbo)
+        return;
+
+    using std::chrono::nanoseconds;
+
+    // the deadline is relative to the epoch, a late frame makes the next wait shorter
+    const uint64_t elapsed_frames = frames - epoch_frame;
+    const Clock::time_point deadline = epoch + nanoseconds(elapsed_frames * NANOSECONDS_PER_SECOND / FRAME_RATE);
+    const Clock::time_point now = Clock::now();
+
+    if(now > deadline + nanoseconds(MAX_LAG_FRAMES * NANOSECONDS_PER_SECOND / FRAME_RATE))
+    {
+        resync();
+        return;
+    }
+
+    if(deadline - now > SPIN_TIME)
+        std::this_thread::sleep_until(deadline - SPIN_TIME);
+
+    while(Clock::now() < deadline)
+        std::this_thread::yield();
+}
+
+void Scheduler::set_clock(uint64_t new_clock)
+{
+    if(new_clock == 0)
+        throw std::invalid_argument("Clock must be at least 1 instruction per second!");
+
+    clock = new_clock;
+}
+
+void Scheduler::set_turbo(bool enabled) noexcept
+{
+    // leaving turbo mode shouldn't try to catch up with the skipped waits
+    if(turbo && not enabled)
+        resync();
+
+    turbo = enabled;
+}
+
+void Scheduler::resync() noexcept
+{
+    epoch       = Clock::now();
+    epoch_frame = frames;
+}
@@ -0,0 +1,58 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include <chrono>
+#include <cstdint>
+
+#include "chip8.hpp"
+
+// Runs the emulator in 60Hz frames, every frame executes the instructions
+// of one sixtieth of the emulated clock and ticks the timers once
+class Scheduler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum
+    {
+        FRAME_RATE    = 60,  // the timers of the chip8 run at 60Hz
+        DEFAULT_CLOCK = 500  // instructions per second
+    };
+
+    // throws when the clock is 0
+    explicit Scheduler(uint64_t clock = DEFAULT_CLOCK, bool turbo = false);
+
+    // run one frame of at most `limit` instructions and tick the timers,
+    // returns how many instructions were executed
+    uint64_t run_frame(Chip8& chip, uint64_t limit = UINT64_MAX) noexcept;
+
+    // block until the next frame is due, returns at once in turbo mode
+    void wait_next_frame() noexcept;
+
+    // instructions of the next frame, the clock doesn't have to be a multiple of 60
+    uint64_t next_frame_instructions() const noexcept;
+
+    // throws when the clock is 0
+    void set_clock(uint64_t new_clock);
+    constexpr uint64_t get_clock() const noexcept { return clock; }
+
+    void set_turbo(bool enabled) noexcept;
+    constexpr bool turbo_enabled() const noexcept { return turbo; }
+
+    constexpr uint64_t get_frames() const noexcept { return frames; }
+
+private:
+    // start counting deadlines again from now
+    void resync() noexcept;
+
+    uint64_t clock;
+    bool     turbo;
+
+    uint64_t frames = 0;
+
+    // deadlines are computed from the epoch so rounding never accumulates
+    Clock::time_point epoch;
+    uint64_t          epoch_frame = 0;
+};
+
+#endif // SCHEDULER_HPP
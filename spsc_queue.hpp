@@ -0,0 +1,61 @@
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// Lock-free ring between one producer and one consumer.
+// Each side only writes its own index, the other one is read to know
+// how far it may go, so neither side ever waits on a lock.
+template<typename T, size_t CAPACITY>
+class Spsc_queue
+{
+public:
+    static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0, "capacity is a power of two");
+
+    // producer: returns false when the queue is full
+    bool try_push(const T& value) noexcept
+    {
+        const size_t tail = write_index.load(std::memory_order_relaxed);
+        if(tail - cached_read == CAPACITY)
+        {
+            cached_read = read_index.load(std::memory_order_acquire);
+            if(tail - cached_read == CAPACITY)
+                return false;
+        }
+
+        slots[tail & (CAPACITY - 1)] = value;
+        write_index.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer: move up to `count` values to `out`, returns how many were moved
+    size_t pop(T* out, size_t count) noexcept
+    {
+        const size_t head = read_index.load(std::memory_order_relaxed);
+        const size_t available = write_index.load(std::memory_order_acquire) - head;
+        const size_t taken = available < count ? available : count;
+
+        for(size_t i = 0; i < taken; i++)
+            out[i] = slots[(head + i) & (CAPACITY - 1)];
+
+        read_index.store(head + taken, std::memory_order_release);
+        return taken;
+    }
+
+    bool empty() const noexcept {
+        return read_index.load(std::memory_order_acquire) == write_index.load(std::memory_order_acquire);
+    }
+
+private:
+    std::array<T, CAPACITY> slots { };
+
+    // the producer and the consumer don't share cache lines,
+    // cached_read saves the producer from reading the consumer's line on every push
+    alignas(64) std::atomic<size_t> write_index { 0 };
+    size_t                          cached_read = 0;
+    alignas(64) std::atomic<size_t> read_index  { 0 };
+};
+
+#endif // SPSC_QUEUE_HPP
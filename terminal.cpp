@@ -0,0 +1,229 @@
+#include "terminal.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <exception>
+#include <stdexcept>
+
+#include <poll.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr int CELL_ROWS = CHIP8_HEIGHT / 2;
+
+    // rewriting this many unchanged cells costs less than moving the cursor over them
+    constexpr int MAX_GAP = 2;
+
+    // a cell is the pixel above and the pixel below it
+    constexpr const char* CELLS[4] = { " ", "▀", "▄", "█" };
+
+    constexpr char CTRL_C    = 0x03;
+    constexpr char ESCAPE    = 0x1B;
+    constexpr char BACKSPACE = 0x7F;
+}
+
+Terminal_renderer::Terminal_renderer(uint32_t max_fps)
+{
+    if(max_fps == 0)
+        throw std::invalid_argument("Terminal frame rate must be above 0!");
+
+    frame_interval = std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(1)) / max_fps;
+
+    set_keymap(Keymap());
+    catch_interrupt();
+
+    // no echo, no line buffering, Ctrl+C arrives as a key
+    is_tty = isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &saved_mode) == 0;
+    if(is_tty)
+    {
+        termios raw = saved_mode;
+        raw.c_lflag &= ~(ECHO | ICANON | ISIG);
+        raw.c_cc[VMIN]  = 0;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    }
+
+    // the alternate screen keeps the shell's scrollback, the cursor is hidden
+    write_out("\x1b[?1049h\x1b[?25l\x1b[2J");
+}
+
+Terminal_renderer::~Terminal_renderer()
+{
+    // the last frame may still be held back by the rate limit
+    if(pending)
+        draw(latest);
+
+    write_out("\x1b[?25h\x1b[?1049l");
+
+    if(is_tty)
+        tcsetattr(STDIN_FILENO, TCSANOW, &saved_mode);
+}
+
+void Terminal_renderer::set_keymap(const Keymap& map) noexcept
+{
+    // characters stand for the key they're printed on
+    for(size_t c = 0; c < char_keys.size(); c++)
+    {
+        char_keys[c] = Keymap::NO_KEY;
+        if(std::isgraph(static_cast<int>(c)) || c == ' ')
+        {
+            const std::string name = c == ' ' ? "space" : std::string(1, static_cast<char>(std::tolower(static_cast<int>(c))));
+            char_keys[c] = map.lookup(Keymap::get_scancode(name));
+        }
+    }
+
+    static constexpr const char* arrows[4] = { "up", "down", "right", "left" };
+    for(size_t i = 0; i < arrow_keys.size(); i++)
+        arrow_keys[i] = map.lookup(Keymap::get_scancode(arrows[i]));
+}
+
+void Terminal_renderer::event_handler(Input_queue& input) noexcept
+{
+    const Clock::time_point now = Clock::now();
+
+    char bytes[64];
+    ssize_t count = 0;
+    while(is_tty && (count = read(STDIN_FILENO, bytes, sizeof(bytes))) > 0)
+    {
+        for(ssize_t i = 0; i < count; i++)
+        {
+            const char c = bytes[i];
+
+            if(c == CTRL_C)
+                running = false;
+            else if(c == BACKSPACE || c == '\b')
+                rewind_until = now + std::chrono::milliseconds(HOLD_MS);
+            else if(c == ESCAPE && i + 2 < count && bytes[i + 1] == '[' && bytes[i + 2] >= 'A' && bytes[i + 2] <= 'D')
+            {
+                press(arrow_keys[bytes[i + 2] - 'A'], now, input);
+                i += 2;
+            }
+            else if(c >= 0)
+                press(char_keys[static_cast<size_t>(c)], now, input);
+        }
+    }
+
+    for(size_t key = 0; key < release_at.size(); key++)
+    {
+        if((held >> key & 1) && now >= release_at[key])
+        {
+            input.push(static_cast<uint8_t>(key), false);
+            held = static_cast<uint16_t>(held & ~(1u << key));
+        }
+    }
+
+    rewinding = now < rewind_until;
+
+    // a frame held back by the rate limit
+    present_pending();
+}
+
+void Terminal_renderer::press(uint8_t key, Clock::time_point now, Input_queue& input) noexcept
+{
+    if(key == Keymap::NO_KEY)
+        return;
+
+    if((held >> key & 1) == 0)
+    {
+        input.push(key, true);
+        held = static_cast<uint16_t>(held | 1u << key);
+    }
+
+    // auto repeat keeps a held key down
+    release_at[key] = now + std::chrono::milliseconds(HOLD_MS);
+}
+
+void Terminal_renderer::wait_event(int timeout_ms) noexcept
+{
+    if(not is_tty)
+        return;
+
+    pollfd in { STDIN_FILENO, POLLIN, 0 };
+    poll(&in, 1, timeout_ms);
+}
+
+void Terminal_renderer::update(const Framebuffer::Packed_display& display, uint32_t dirty_rows) noexcept
+{
+    if(dirty_rows != 0 || not has_shown)
+    {
+        latest  = display;
+        pending = true;
+    }
+
+    present_pending();
+}
+
+void Terminal_renderer::present_pending() noexcept
+{
+    const Clock::time_point now = Clock::now();
+    if(not pending || now - last_present < frame_interval)
+        return;
+
+    draw(latest);
+
+    pending      = false;
+    last_present = now;
+}
+
+void Terminal_renderer::draw(const Framebuffer::Packed_display& display) noexcept
+{
+    output.clear();
+
+    for(int line = 0; line < CELL_ROWS; line++)
+    {
+        const uint64_t top    = display[line * 2];
+        const uint64_t bottom = display[line * 2 + 1];
+
+        uint64_t changed = (top ^ shown[line * 2]) | (bottom ^ shown[line * 2 + 1]);
+        if(not has_shown)
+            changed = UINT64_MAX;
+
+        // runs of changed cells, column 0 is bit 63
+        while(changed != 0)
+        {
+            const int x = __builtin_clzll(changed);
+
+            int last = x;
+            for(int next = x + 1; next < CHIP8_WIDTH && next - last <= MAX_GAP + 1; next++)
+            {
+                if(changed >> (63 - next) & 1)
+                    last = next;
+            }
+
+            output += "\x1b[";
+            output += std::to_string(line + 1);
+            output += ';';
+            output += std::to_string(x + 1);
+            output += 'H';
+            for(int column = x; column <= last; column++)
+            {
+                const int cell = static_cast<int>((top >> (63 - column) & 1) | (bottom >> (63 - column) & 1) << 1);
+                output += CELLS[cell];
+            }
+
+            // everything from the start of the line to `last` is done
+            changed &= last == 63 ? 0 : UINT64_MAX >> (last + 1);
+        }
+    }
+
+    shown     = display;
+    has_shown = true;
+
+    write_out(output);
+}
+
+void Terminal_renderer::write_out(const std::string& text) noexcept
+{
+    size_t done = 0;
+    while(done < text.size())
+    {
+        const ssize_t written = write(STDOUT_FILENO, text.data() + done, text.size() - done);
+        if(written <= 0)
+            return;
+
+        done += static_cast<size_t>(written);
+    }
+
+    bytes_written += done;
+}
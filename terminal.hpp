@@ -0,0 +1,86 @@
+#ifndef TERMINAL_HPP
+#define TERMINAL_HPP
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include <termios.h>
+
+#include "renderer.hpp"
+
+// Draws the display on the terminal with half blocks, two pixel rows per line.
+// Only the cells that changed since the last frame are written again, and
+// frames come at most `max_fps` times a second, the last one is never skipped.
+//
+// Terminals only report key presses, a key counts as held until
+// HOLD_MS passed without it arriving again. Ctrl+C quits, backspace rewinds.
+// Without a terminal on stdin there's no input and SIGINT quits.
+class Terminal_renderer final : public Renderer
+{
+public:
+    enum
+    {
+        DEFAULT_MAX_FPS = 30,
+        HOLD_MS         = 200
+    };
+
+    // throws when `max_fps` is 0
+    explicit Terminal_renderer(uint32_t max_fps = DEFAULT_MAX_FPS);
+
+    // puts the terminal back as it was
+    ~Terminal_renderer() override;
+
+    Terminal_renderer(const Terminal_renderer&) = delete;
+    Terminal_renderer& operator=(const Terminal_renderer&) = delete;
+
+    void event_handler(Input_queue& input) noexcept override;
+    void update(const Framebuffer::Packed_display& display, uint32_t dirty_rows) noexcept override;
+    void wait_event(int timeout_ms) noexcept override;
+
+    bool is_running() const noexcept override { return running && not was_interrupted(); }
+    bool is_rewinding() const noexcept override { return rewinding; }
+
+    void set_keymap(const Keymap& map) noexcept override;
+
+    // everything sent to the terminal so far, escape sequences included
+    constexpr uint64_t get_bytes_written() const noexcept { return bytes_written; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void press(uint8_t key, Clock::time_point now, Input_queue& input) noexcept;
+    void present_pending() noexcept;
+    void draw(const Framebuffer::Packed_display& display) noexcept;
+    void write_out(const std::string& text) noexcept;
+
+    Clock::duration frame_interval;
+    Clock::time_point last_present { };
+
+    // what the terminal shows now and the newest frame not shown yet
+    Framebuffer::Packed_display shown { };
+    Framebuffer::Packed_display latest { };
+    bool has_shown = false;
+    bool pending   = false;
+
+    std::string output;
+    uint64_t    bytes_written = 0;
+
+    // keypad index of every ASCII character and of the arrows, up down right left
+    std::array<uint8_t, 128> char_keys;
+    std::array<uint8_t, 4>   arrow_keys;
+
+    // the keypad keys held and when they're let go
+    uint16_t held = 0;
+    std::array<Clock::time_point, KEYPADS_SIZE> release_at { };
+    Clock::time_point rewind_until { };
+
+    bool is_tty    = false;
+    bool running   = true;
+    bool rewinding = false;
+
+    termios saved_mode { };
+};
+
+#endif // TERMINAL_HPP
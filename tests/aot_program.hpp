@@ -0,0 +1,31 @@
+#ifndef AOT_PROGRAM_HPP
+#define AOT_PROGRAM_HPP
+
+#include <cstdint>
+
+// translated by chip8-aot at build time and run by aot_tests: draws, stores,
+// calls and random numbers in a loop, then overflows the stack, underflows it
+// and halts fetching past the end of memory
+constexpr uint8_t AOT_PROGRAM[] {
+    0x60, 0x05,  // 200: V0 = 5
+    0x61, 0x00,  // 202: V1 = 0
+    0xA0, 0x0A,  // 204: I = font "2"
+    0xD0, 0x15,  // 206: draw at (V0, V1)
+    0x71, 0x03,  // 208: V1 += 3
+    0x82, 0x14,  // 20A: V2 += V1
+    0xC3, 0x0F,  // 20C: V3 = random & 0x0F
+    0xAE, 0x00,  // 20E: I = 0xE00
+    0xF3, 0x55,  // 210: store V0..V3
+    0xF2, 0x33,  // 212: BCD of V2
+    0xF0, 0x65,  // 214: load V0
+    0x22, 0x22,  // 216: call 222
+    0x31, 0x1E,  // 218: skip when V1 == 30
+    0x12, 0x04,  // 21A: jump 204
+    0x22, 0x1C,  // 21C: call itself until the stack overflows
+    0x00, 0xEE,  // 21E: return until the stack underflows
+    0x1F, 0xFE,  // 220: jump to the last word of memory
+    0x70, 0x01,  // 222: V0 += 1
+    0x00, 0xEE   // 224: return
+};
+
+#endif // AOT_PROGRAM_HPP
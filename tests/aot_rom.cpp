@@ -0,0 +1,21 @@
+// Writes the program of aot_program.hpp as a ROM for chip8-aot to translate.
+
+#include "aot_program.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+int main(int argc, char* argv[])
+{
+    if(argc != 2)
+    {
+        std::cerr << "Usage: chip8_aot_rom <output.ch8>\n";
+        return EXIT_FAILURE;
+    }
+
+    std::ofstream rom(argv[1], std::ofstream::binary);
+    rom.write(reinterpret_cast<const char*>(AOT_PROGRAM), sizeof(AOT_PROGRAM));
+
+    return rom ? EXIT_SUCCESS : EXIT_FAILURE;
+}
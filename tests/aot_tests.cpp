@@ -0,0 +1,62 @@
+// Checks that the program of aot_program.hpp, translated by chip8-aot,
+// leaves the machine exactly where the interpreter does.
+
+#include "../chip8.hpp"
+#include "aot_program.hpp"
+
+#include <cstdlib>
+#include <iostream>
+
+// generated from aot_program.hpp at build time
+uint64_t chip8_aot_run(Chip8& chip, uint64_t instructions) noexcept;
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool condition, const char* what)
+    {
+        if(not condition)
+        {
+            std::cerr << "failed: " << what << "\n";
+            failures++;
+        }
+    }
+
+    // runs both in slices of `slice` instructions and compares after every slice,
+    // small slices leave blocks without the budget to run whole
+    void test_slices(uint64_t slice)
+    {
+        Chip8 interpreted(AOT_PROGRAM, sizeof(AOT_PROGRAM));
+        interpreted.seed(42);
+
+        Chip8 translated(AOT_PROGRAM, sizeof(AOT_PROGRAM));
+        translated.seed(42);
+
+        bool same = true;
+        for(uint64_t executed = 0; executed < 2'000; executed += slice)
+        {
+            interpreted.run(slice);
+            chip8_aot_run(translated, slice);
+
+            same = same && translated.state_hash() == interpreted.state_hash();
+        }
+
+        check(same, "the translation hashes like the interpreter");
+        check(translated.get_cycles() == interpreted.get_cycles(), "the translation counts its cycles");
+        check(translated.get_trap() == Chip8::Trap::MEMORY_OUT_OF_RANGE && translated.pc == MEMORY_SIZE,
+              "the program ran to its end");
+    }
+}
+
+int main()
+{
+    for(uint64_t slice : { 1, 3, 16, 2'000 })
+        test_slices(slice);
+
+    if(failures > 0)
+        return EXIT_FAILURE;
+
+    std::cout << "all tests passed\n";
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,336 @@
+// Checks that the interpreter paths agree with each other and that
+// snapshots and forks continue exactly where they were taken.
+
+#include "../chip8.hpp"
+#include "../input.hpp"
+#include "../capture.hpp"
+#include "temporary_file.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <exception>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool condition, const char* what)
+    {
+        if(not condition)
+        {
+            std::cerr << "failed: " << what << "\n";
+            failures++;
+        }
+    }
+
+    // draws, counts, stores and calls a subroutine in a loop
+    const std::vector<uint8_t> PROGRAM {
+        0x60, 0x05,  // 200: V0 = 5
+        0x61, 0x00,  // 202: V1 = 0
+        0xA0, 0x0A,  // 204: I = font "2"
+        0xD0, 0x15,  // 206: draw at (V0, V1)
+        0x71, 0x03,  // 208: V1 += 3
+        0x82, 0x14,  // 20A: V2 += V1
+        0xC3, 0x0F,  // 20C: V3 = random & 0x0F
+        0xAE, 0x00,  // 20E: I = 0xE00
+        0xF3, 0x55,  // 210: store V0..V3
+        0x22, 0x1A,  // 212: call 21A
+        0x31, 0x1E,  // 214: skip when V1 == 30
+        0x12, 0x04,  // 216: jump 204
+        0x12, 0x00,  // 218: jump 200
+        0x70, 0x01,  // 21A: V0 += 1
+        0x00, 0xEE   // 21C: return
+    };
+
+    Chip8 make_machine()
+    {
+        Chip8 chip(PROGRAM.data(), PROGRAM.size());
+        chip.seed(42);
+        return chip;
+    }
+
+    void test_decode()
+    {
+        check(std::strcmp(Chip8::get_opcode_name(Chip8::get_opcode_class(0x00E0)), "00E0") == 0, "00E0 decodes");
+        check(std::strcmp(Chip8::get_opcode_name(Chip8::get_opcode_class(0x8AB4)), "8XY4") == 0, "8XY4 decodes");
+        check(std::strcmp(Chip8::get_opcode_name(Chip8::get_opcode_class(0xD123)), "DXYN") == 0, "DXYN decodes");
+        check(std::strcmp(Chip8::get_opcode_name(Chip8::get_opcode_class(0xF3FF)), "illegal") == 0, "FXFF is illegal");
+    }
+
+    void test_paths_agree()
+    {
+        Chip8 reference = make_machine();
+        reference.set_decode_cache(false);
+        reference.run(100'000);
+
+        Chip8 cached = make_machine();
+        cached.set_fusion(false);
+        cached.run(100'000);
+        check(cached.state_hash() == reference.state_hash(), "decode cache matches decoding every word");
+
+        Chip8 fused = make_machine();
+        fused.run(100'000);
+        check(fused.state_hash() == reference.state_hash(), "fusion matches decoding every word");
+
+        Chip8 jit = make_machine();
+        try
+        {
+            jit.set_backend(Chip8::Backend::JIT);
+        }
+        catch(const std::runtime_error&)
+        {
+            return;
+        }
+
+        jit.run(100'000);
+        check(jit.state_hash() == reference.state_hash(), "JIT matches decoding every word");
+    }
+
+    void test_snapshots()
+    {
+        Chip8 chip = make_machine();
+        chip.run(12'345);
+
+        Chip8::State state;
+        chip.save_state(state);
+        Chip8 fork = chip.fork();
+
+        chip.run(50'000);
+
+        Chip8 restored(state);
+        restored.run(50'000);
+        check(restored.state_hash() == chip.state_hash(), "a loaded state continues like the original");
+
+        fork.run(50'000);
+        check(fork.state_hash() == chip.state_hash(), "a fork continues like the original");
+    }
+
+    // skipping an idle loop ends exactly where executing it would
+    void test_idle_loops()
+    {
+        const std::vector<uint8_t> program {
+            0x6A, 0x03,  // 200: VA = 3
+            0xFA, 0x15,  // 202: delay timer = VA
+            0xFB, 0x07,  // 204: VB = delay timer
+            0x3B, 0x00,  // 206: skip when VB == 0
+            0x12, 0x04,  // 208: jump 204
+            0xF1, 0x0A,  // 20A: wait for a key
+            0x12, 0x0C   // 20C: jump 20C
+        };
+
+        Chip8 fast(program.data(), program.size());
+        Chip8 slow(program.data(), program.size());
+
+        for(int frame = 0; frame < 10; frame++)
+        {
+            fast.run(1000);
+            for(int i = 0; i < 1000; i++)
+                slow.cycle();
+
+            check(fast.pc == slow.pc && fast.registers == slow.registers, "idle loops are skipped exactly");
+
+            fast.tick_timers();
+            slow.tick_timers();
+        }
+
+        check(fast.get_idle() == Chip8::Idle::KEY && fast.waits_for_input(), "waiting for a key is idle");
+
+        const Chip8 fork = fast.fork();
+        check(fork.get_idle() == Chip8::Idle::KEY && fork.waits_for_input(), "a fork waits like the original");
+
+        fast.keypads[5] = 1;
+        check(fast.run(1'000'000'000'000) == 1'000'000'000'000 && fast.get_idle() == Chip8::Idle::JUMP &&
+              fast.registers[1] == 5, "a jump to itself is skipped");
+    }
+
+    // the flag follows the sound timer without anyone polling the machine
+    void test_sound_flag()
+    {
+        const std::vector<uint8_t> program {
+            0x60, 0x02,  // 200: V0 = 2
+            0xF0, 0x18,  // 202: sound timer = V0
+            0x12, 0x04   // 204: jump 204
+        };
+
+        Chip8 chip(program.data(), program.size());
+        std::atomic<bool> sound { true };
+        chip.set_sound_flag(&sound);
+        check(not sound.load(), "the flag starts with the timer");
+
+        chip.run(2);
+        check(sound.load() && chip.is_sound_on(), "FX18 starts the tone");
+
+        chip.tick_timers();
+        check(sound.load(), "the tone lasts while the timer is above 0");
+
+        chip.tick_timers();
+        check(not sound.load() && not chip.is_sound_on(), "the tone stops with the timer");
+    }
+
+    // a tap shorter than a frame still reaches the machine for one frame
+    void test_input_queue()
+    {
+        std::istringstream file("# layout\n1 up\nA Space # jump\n");
+        const Keymap keymap(file);
+        check(keymap.lookup(82) == 1 && keymap.lookup(44) == 0xA && keymap.lookup(27) == Keymap::NO_KEY,
+              "keymaps map scancodes");
+
+        std::istringstream broken("1 nokey\n");
+        try
+        {
+            Keymap{ broken };
+            check(false, "unknown key names are rejected");
+        }
+        catch(const std::invalid_argument&)
+        {
+        }
+
+        Chip8 chip(PROGRAM.data(), PROGRAM.size());
+        Input_queue input;
+        input.push(keymap.lookup(82), true);
+        input.push(keymap.lookup(82), false);
+        input.push(0xA, true);
+        check(not input.push(Keymap::NO_KEY, true), "keys outside the keypad are refused");
+
+        check(input.drain(chip) == 1 && chip.keypads[1] == 1 && chip.keypads[0xA] == 0, "a frame stops before a second change of a key");
+        check(input.drain(chip) == 2 && chip.keypads[1] == 0 && chip.keypads[0xA] == 1, "the next frame goes on in order");
+        check(input.drain(chip) == 0, "the queue is empty");
+    }
+
+    // unchanged frames are captured once but still fill the raw stream
+    void test_capture()
+    {
+        const std::vector<uint8_t> program { 0xA0, 0x00, 0xD0, 0x05, 0x12, 0x04 };
+        const Temporary_file file_path("chip8_capture_test");
+        const std::string path = file_path.string();
+
+        uint64_t captured = 0;
+        {
+            Chip8 chip(program.data(), program.size());
+            Capture capture(path, Capture::Format::RAW);
+
+            for(int frame = 0; frame < 10; frame++)
+            {
+                chip.run(1);
+                capture.on_frame(chip);
+            }
+
+            captured = capture.get_captured();
+        }
+
+        std::ifstream file(path, std::ifstream::binary | std::ifstream::ate);
+        check(captured == 2 && file.tellg() == 10 * CHIP8_WIDTH * CHIP8_HEIGHT, "raw captures keep every frame");
+    }
+
+    // runs `program` on every backend, they have to agree on the state and the trap
+    Chip8 run_everywhere(const std::vector<uint8_t>& program, uint64_t instructions, const char* what)
+    {
+        Chip8 reference(program.data(), program.size());
+        reference.seed(42);
+        reference.set_decode_cache(false);
+        reference.run(instructions);
+
+        Chip8 cached(program.data(), program.size());
+        cached.seed(42);
+        cached.run(instructions);
+        check(cached.state_hash() == reference.state_hash(), what);
+
+        Chip8 jit(program.data(), program.size());
+        jit.seed(42);
+        try
+        {
+            jit.set_backend(Chip8::Backend::JIT);
+            jit.run(instructions);
+            check(jit.state_hash() == reference.state_hash(), what);
+        }
+        catch(const std::runtime_error&)
+        {
+        }
+
+        return reference;
+    }
+
+    void test_traps()
+    {
+        using Trap = Chip8::Trap;
+
+        // 00EE with nothing on the stack
+        const Chip8 underflow = run_everywhere({ 0x00, 0xEE }, 64, "paths agree on a stack underflow");
+        check(underflow.get_trap() == Trap::STACK_UNDERFLOW && underflow.get_trap_address() == 0x200 && underflow.sp == 0,
+              "returning from an empty stack traps");
+
+        // a call to itself fills the stack
+        const Chip8 overflow = run_everywhere({ 0x22, 0x00 }, 64, "paths agree on a stack overflow");
+        check(overflow.get_trap() == Trap::STACK_OVERFLOW && overflow.get_trap_address() == 0x200 && overflow.sp == STACK_SIZE,
+              "a call with a full stack traps");
+
+        // I = 0xFFE, store V0..V3
+        const Chip8 store = run_everywhere({ 0xAF, 0xFE, 0xF3, 0x55, 0x12, 0x04 }, 64, "paths agree on a store past memory");
+        check(store.get_trap() == Trap::MEMORY_OUT_OF_RANGE && store.get_trap_address() == 0x202,
+              "storing past the last byte traps");
+
+        // I = 0xFFF, V0 = 7, store V0, the last byte is memory too
+        const Chip8 last_byte = run_everywhere({ 0xAF, 0xFF, 0x60, 0x07, 0xF0, 0x55, 0x12, 0x06 }, 64, "paths agree on the last byte");
+        check(last_byte.get_trap() == Trap::NONE && last_byte.memory[0xFFF] == 7, "the last byte can be written");
+
+        // I = 0xFFE, load V0..V2
+        const Chip8 load = run_everywhere({ 0xAF, 0xFE, 0xF2, 0x65, 0x12, 0x04 }, 64, "paths agree on a load past memory");
+        check(load.get_trap() == Trap::MEMORY_OUT_OF_RANGE && load.get_trap_address() == 0x202,
+              "loading past the last byte traps");
+
+        // V0 = 0, jump to 0xFFF, the word there would end past memory
+        const Chip8 fetch = run_everywhere({ 0x60, 0x00, 0xBF, 0xFF }, 64, "paths agree on a fetch past memory");
+        check(fetch.get_trap() == Trap::MEMORY_OUT_OF_RANGE && fetch.get_trap_address() == 0xFFF && fetch.pc == 0xFFF,
+              "fetching past the last byte traps and halts");
+    }
+
+    void test_draw_collision()
+    {
+        // the same sprite twice erases it and reports the collision
+        const std::vector<uint8_t> program { 0xA0, 0x00, 0xD0, 0x05, 0xD0, 0x05 };
+        Chip8 chip(program.data(), program.size());
+
+        chip.run(2);
+        check(chip.display[0] != 0 && chip.registers[0xF] == 0, "first draw sets pixels");
+
+        chip.run(1);
+        bool cleared = true;
+        for(uint64_t row : chip.display)
+            cleared = cleared && row == 0;
+
+        check(cleared && chip.registers[0xF] == 1, "second draw erases and collides");
+    }
+}
+
+int main()
+{
+    try
+    {
+        test_decode();
+        test_paths_agree();
+        test_snapshots();
+        test_idle_loops();
+        test_sound_flag();
+        test_input_queue();
+        test_capture();
+        test_draw_collision();
+        test_traps();
+    }
+    catch(const std::exception& error)
+    {
+        std::cerr << error.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    if(failures > 0)
+        return EXIT_FAILURE;
+
+    std::cout << "all tests passed\n";
+    return EXIT_SUCCESS;
+}
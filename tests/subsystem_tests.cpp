@@ -0,0 +1,381 @@
+// Checks the subsystems built around the interpreter against it: lockstep
+// lanes against forks, rewinding against saved states, replays against the
+// recorded run, traces and the environment pool against the machines they
+// came from. Also checks the thread pool, the profiler and the metrics.
+
+#include "../chip8.hpp"
+#include "../environment.hpp"
+#include "../headless.hpp"
+#include "../input.hpp"
+#include "../lockstep.hpp"
+#include "../metrics.hpp"
+#include "../profiler.hpp"
+#include "../replay.hpp"
+#include "../rewind.hpp"
+#include "../scheduler.hpp"
+#include "../thread_pool.hpp"
+#include "../tracer.hpp"
+#include "temporary_file.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool condition, const char* what)
+    {
+        if(not condition)
+        {
+            std::cerr << "failed: " << what << "\n";
+            failures++;
+        }
+    }
+
+    // random rows make the lanes go their own way, some of them
+    // return with an empty stack and every lane stores what it drew
+    const std::vector<uint8_t> DIVERGING_PROGRAM {
+        0xA0, 0x00,  // 200: I = font "0"
+        0xC1, 0x07,  // 202: V1 = random & 0x07
+        0x70, 0x01,  // 204: V0 += 1
+        0xD0, 0x15,  // 206: draw at (V0, V1)
+        0x41, 0x03,  // 208: skip when V1 != 3
+        0x22, 0x14,  // 20A: call 214
+        0x31, 0x00,  // 20C: skip when V1 == 0
+        0x12, 0x02,  // 20E: jump 202
+        0x00, 0xEE,  // 210: return with an empty stack
+        0x12, 0x00,  // 212: jump 200
+        0xAE, 0x00,  // 214: I = 0xE00
+        0xF2, 0x55,  // 216: store V0..V2
+        0xF2, 0x65,  // 218: load V0..V2
+        0xA0, 0x00,  // 21A: I = font "0"
+        0x00, 0xEE   // 21C: return
+    };
+
+    // counts the presses of every key and draws at a random column in between
+    const std::vector<uint8_t> KEY_PROGRAM {
+        0x60, 0x00,  // 200: V0 = 0
+        0xE0, 0x9E,  // 202: skip when key V0 is pressed
+        0x12, 0x08,  // 204: jump 208
+        0x71, 0x01,  // 206: V1 += 1
+        0x70, 0x01,  // 208: V0 += 1
+        0x30, 0x10,  // 20A: skip when V0 == 16
+        0x12, 0x02,  // 20C: jump 202
+        0xC2, 0x3F,  // 20E: V2 = random & 0x3F
+        0xD2, 0x15,  // 210: draw at (V2, V1)
+        0x12, 0x00   // 212: jump 200
+    };
+
+    Chip8 make_machine(const std::vector<uint8_t>& program, uint64_t seed)
+    {
+        Chip8 chip(program.data(), program.size());
+        chip.seed(seed);
+        return chip;
+    }
+
+    // everything a lane holds, the cycle counter of a lane isn't kept
+    bool same_machine(const Chip8& a, const Chip8& b)
+    {
+        return a.display == b.display && a.stack == b.stack && a.memory == b.memory &&
+               a.registers == b.registers && a.pc == b.pc && a.I == b.I && a.sp == b.sp &&
+               a.dt == b.dt && a.st == b.st && a.get_trap() == b.get_trap() &&
+               a.get_trap_address() == b.get_trap_address();
+    }
+
+    template<size_t LANES>
+    void test_lockstep()
+    {
+        const Chip8 machine = make_machine(DIVERGING_PROGRAM, 0);
+        Lockstep_group<LANES> group(machine, 100);
+
+        std::vector<Chip8> forks;
+        for(size_t lane = 0; lane < LANES; lane++)
+        {
+            forks.push_back(machine.fork());
+            forks.back().seed(100 + lane);
+        }
+
+        for(int frame = 0; frame < 50; frame++)
+        {
+            group.run(97);
+            group.tick_timers();
+
+            for(Chip8& fork : forks)
+            {
+                fork.run(97);
+                fork.tick_timers();
+            }
+        }
+
+        bool same = true;
+        bool trapped = false;
+        for(size_t lane = 0; lane < LANES; lane++)
+        {
+            same    = same && same_machine(group.get_lane(lane), forks[lane]);
+            trapped = trapped || forks[lane].get_trap() == Chip8::Trap::STACK_UNDERFLOW;
+        }
+
+        check(same, "lockstep lanes end like forks of the machine");
+        check(trapped && group.get_scalar_instructions() > 0, "some lanes went through their own machine");
+    }
+
+    // the ring wraps three times before going back through all of it
+    void test_rewind()
+    {
+        constexpr size_t CAPACITY = 8;
+
+        Chip8 chip = make_machine(DIVERGING_PROGRAM, 3);
+        Scheduler scheduler(Scheduler::DEFAULT_CLOCK, true);
+        Rewind_buffer rewind(CAPACITY);
+
+        std::vector<Chip8::State> states;
+        for(size_t frame = 0; frame < CAPACITY * 3 + 5; frame++)
+        {
+            scheduler.run_frame(chip);
+            rewind.push(chip);
+
+            states.emplace_back();
+            chip.save_state(states.back());
+        }
+
+        bool same = true;
+        for(size_t back = 0; back < CAPACITY; back++)
+        {
+            Chip8::State state;
+            const bool rewound = rewind.rewind(chip);
+            chip.save_state(state);
+            same = same && rewound && state == states[states.size() - 1 - back];
+        }
+
+        check(same, "every rewind lands on the state saved at that frame");
+        check(not rewind.rewind(chip), "the ring keeps no more than its capacity");
+    }
+
+    // keys change at frame boundaries like in the frontend, the replay has to end on the same state
+    void test_replay()
+    {
+        const Temporary_file path("chip8_replay_test");
+        uint64_t recorded_hash = 0;
+
+        {
+            Chip8 chip = make_machine(KEY_PROGRAM, 9);
+            Scheduler scheduler(Scheduler::DEFAULT_CLOCK, true);
+            Input_queue input;
+            Input_recorder recorder(path.string(), chip.get_seed(), scheduler.get_clock());
+
+            for(uint8_t frame = 0; frame < 120; frame++)
+            {
+                const uint8_t key = frame / 10 % KEYPADS_SIZE;
+
+                if(frame % 10 == 3)
+                    input.push(key, true);
+                else if(frame % 10 == 7)
+                    input.push(key, false);
+
+                input.drain(chip, &recorder);
+                scheduler.run_frame(chip);
+            }
+
+            recorder.set_end(chip.get_cycles());
+            recorded_hash = chip.state_hash();
+        }
+
+        Input_replay replay(path.string());
+        Chip8 chip = make_machine(KEY_PROGRAM, replay.get_seed());
+
+        Headless_options options;
+        options.instructions = replay.get_end_cycle();
+        options.clock        = replay.get_clock();
+        run_headless(chip, options, &replay);
+
+        check(chip.state_hash() == recorded_hash, "a replay ends on the recorded state");
+        check(chip.registers[1] > 0, "the program saw the recorded keys");
+    }
+
+    bool same_record(const Trace_record& a, const Trace_record& b)
+    {
+        return a.cycle == b.cycle && a.pc == b.pc && a.opcode == b.opcode &&
+               a.reg == b.reg && a.value == b.value && a.I == b.I;
+    }
+
+    // more records than the ring holds, so the writer drains it many times
+    void test_trace()
+    {
+        const Temporary_file path("chip8_trace_test");
+
+        std::vector<Trace_record> written;
+        for(uint32_t i = 0; i < 100'000; i++)
+        {
+            written.push_back({ 0x0123456789ull * i, static_cast<uint16_t>(0x200 + i % 0xE00),
+                                static_cast<uint16_t>(i * 7), static_cast<uint8_t>(i % 17),
+                                static_cast<uint8_t>(i), static_cast<uint16_t>(i * 3) });
+        }
+
+        {
+            Tracer tracer(path.string());
+            for(const Trace_record& record : written)
+                tracer.record(record);
+        }
+
+        Trace_reader reader(path.string());
+        Trace_record record { };
+
+        bool same = true;
+        size_t read = 0;
+        while(reader.next(record))
+        {
+            same = same && read < written.size() && same_record(record, written[read]);
+            read++;
+        }
+
+        check(same && read == written.size(), "a trace reads back the records written to it");
+
+        // a traced run records every instruction it executes
+        const Temporary_file run_path("chip8_trace_run_test");
+        Chip8 chip = make_machine(DIVERGING_PROGRAM, 5);
+        {
+            Tracer tracer(run_path.string());
+            chip.set_tracer(&tracer);
+            chip.run(5'000);
+            chip.set_tracer(nullptr);
+        }
+
+        Trace_reader run_reader(run_path.string());
+        uint64_t cycle = 0;
+        bool in_order = true;
+        while(run_reader.next(record))
+            in_order = in_order && record.cycle == cycle++;
+
+        check(in_order && cycle == 5'000, "a traced run records every instruction once");
+    }
+
+    void test_thread_pool()
+    {
+        constexpr size_t TASKS = 1'000;
+
+        Thread_pool pool(4);
+        std::atomic<size_t> finished { 0 };
+
+        bool all_done = true;
+        for(size_t round = 1; round <= 3; round++)
+        {
+            for(size_t i = 0; i < TASKS; i++)
+                pool.submit([&finished] { finished++; });
+
+            pool.wait();
+            all_done = all_done && finished == round * TASKS;
+        }
+
+        check(all_done, "wait() returns once every submitted task has run");
+    }
+
+    // every environment runs like a fork with its seed and keys
+    void test_environment_pool()
+    {
+        constexpr size_t COUNT  = 4;
+        constexpr uint32_t FRAMES = 20;
+
+        const Chip8 machine = make_machine(KEY_PROGRAM, 0);
+        Environment_pool pool(machine, COUNT);
+        pool.reset(50);
+
+        const uint16_t masks[COUNT] { 0x0000, 0x0008, 0xFFFF, 0x8001 };
+        pool.step(masks, FRAMES);
+
+        bool same = true;
+        for(size_t env = 0; env < COUNT; env++)
+        {
+            Chip8 chip = machine.fork();
+            chip.seed(50 + env);
+            for(size_t key = 0; key < KEYPADS_SIZE; key++)
+                chip.keypads[key] = masks[env] >> key & 1;
+
+            Scheduler scheduler(Scheduler::DEFAULT_CLOCK, true);
+            for(uint32_t frame = 0; frame < FRAMES; frame++)
+                scheduler.run_frame(chip);
+
+            same = same && pool.get_machine(env).state_hash() == chip.state_hash();
+            same = same && std::memcmp(pool.get_observation(env), chip.display.data(), sizeof(chip.display)) == 0;
+        }
+
+        check(same, "environments run like forks of the machine");
+        check(pool.get_machine(2).registers[1] != pool.get_machine(0).registers[1], "the keys of each environment count");
+    }
+
+    // profiling neither changes the run nor misses an instruction
+    void test_profiler()
+    {
+        #if ENABLE_PROFILER
+        Chip8 reference = make_machine(DIVERGING_PROGRAM, 8);
+        reference.run(10'000);
+
+        Chip8 chip = make_machine(DIVERGING_PROGRAM, 8);
+        Profiler profiler;
+        chip.set_profiler(&profiler);
+        chip.run(10'000);
+        chip.set_profiler(nullptr);
+
+        uint64_t counted = 0;
+        for(size_t opcode_class = 0; opcode_class < Chip8::OPCODE_CLASS_COUNT; opcode_class++)
+            counted += profiler.get_class_count(opcode_class);
+
+        check(chip.state_hash() == reference.state_hash(), "a profiled run ends like any other");
+        check(counted == 10'000 && profiler.get_address_count(0x200) > 0, "the profiler counts every instruction");
+        #endif // ENABLE_PROFILER
+    }
+
+    void test_metrics()
+    {
+        Metrics metrics({ }, std::chrono::milliseconds(1));
+
+        metrics.add_instructions(1'000);
+        metrics.add_time(Metrics::Phase::EMULATE, std::chrono::milliseconds(1));
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+
+        const bool ended = metrics.end_frame();
+        const Metrics::Snapshot& snapshot = metrics.get_snapshot();
+
+        check(ended && snapshot.frames == 1, "a frame past the period ends it");
+        check(snapshot.instructions_per_second > 0 &&
+              snapshot.instructions_per_second * snapshot.seconds > 999 &&
+              snapshot.instructions_per_second * snapshot.seconds < 1'001, "the period counts its instructions");
+        check(snapshot.phase_share[static_cast<size_t>(Metrics::Phase::EMULATE)] > 0, "the period counts its phases");
+
+        metrics.end_frame();
+        check(metrics.get_snapshot().frames == 1, "a snapshot stays until the next period ends");
+    }
+}
+
+int main()
+{
+    try
+    {
+        test_lockstep<8>();
+        test_lockstep<32>();
+        test_rewind();
+        test_replay();
+        test_trace();
+        test_thread_pool();
+        test_environment_pool();
+        test_profiler();
+        test_metrics();
+    }
+    catch(const std::exception& error)
+    {
+        std::cerr << error.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    if(failures > 0)
+        return EXIT_FAILURE;
+
+    std::cout << "all tests passed\n";
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,32 @@
+#ifndef TEMPORARY_FILE_HPP
+#define TEMPORARY_FILE_HPP
+
+#include <filesystem>
+#include <random>
+#include <string>
+#include <system_error>
+
+// a unique file in the temporary directory, removed with the object
+class Temporary_file
+{
+public:
+    explicit Temporary_file(const std::string& name)
+        : path(std::filesystem::temp_directory_path() /
+               (name + "_" + std::to_string(std::random_device{}()))) {}
+
+    ~Temporary_file()
+    {
+        std::error_code error;
+        std::filesystem::remove(path, error);
+    }
+
+    Temporary_file(const Temporary_file&) = delete;
+    Temporary_file& operator=(const Temporary_file&) = delete;
+
+    std::string string() const { return path.string(); }
+
+private:
+    std::filesystem::path path;
+};
+
+#endif // TEMPORARY_FILE_HPP
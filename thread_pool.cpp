@@ -0,0 +1,116 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+Thread_pool::Thread_pool(size_t threads)
+{
+    if(threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for(size_t i = 0; i < threads; i++)
+        queues.push_back(std::make_unique<Worker_queue>());
+
+    for(size_t i = 0; i < threads; i++)
+        workers.emplace_back(&Thread_pool::work, this, i);
+}
+
+Thread_pool::~Thread_pool()
+{
+    wait();
+
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex);
+        stopping = true;
+    }
+    idle.notify_all();
+
+    for(std::thread& worker : workers)
+        worker.join();
+}
+
+void Thread_pool::submit(Task task)
+{
+    Worker_queue& queue = *queues[next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size()];
+
+    // counted before it is visible, a worker that takes it right away must
+    // not bring queued or pending below zero. The idle lock makes sure a
+    // worker about to sleep sees the new task
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex);
+        queued++;
+        pending++;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    idle.notify_one();
+}
+
+void Thread_pool::wait()
+{
+    std::unique_lock<std::mutex> lock(idle_mutex);
+    done.wait(lock, [this] { return pending == 0; });
+}
+
+void Thread_pool::work(size_t index)
+{
+    Task task;
+    while(true)
+    {
+        if(pop(index, task) || steal(index, task))
+        {
+            queued--;
+
+            task();
+            task = nullptr;
+
+            if(pending.fetch_sub(1) == 1)
+            {
+                std::lock_guard<std::mutex> lock(idle_mutex);
+                done.notify_all();
+            }
+
+            continue;
+        }
+
+        // every deque looked empty, sleep until something is submitted
+        std::unique_lock<std::mutex> lock(idle_mutex);
+        idle.wait(lock, [this] { return stopping || queued > 0; });
+
+        if(stopping && queued == 0)
+            return;
+    }
+}
+
+bool Thread_pool::pop(size_t index, Task& task)
+{
+    Worker_queue& queue = *queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    if(queue.tasks.empty())
+        return false;
+
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool Thread_pool::steal(size_t index, Task& task)
+{
+    for(size_t i = 1; i < queues.size(); i++)
+    {
+        Worker_queue& queue = *queues[(index + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        if(queue.tasks.empty())
+            continue;
+
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        return true;
+    }
+
+    return false;
+}
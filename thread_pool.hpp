@@ -0,0 +1,63 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of workers, each with its own deque of tasks.
+// A worker takes from the back of its own deque and steals from the front
+// of the others once it runs dry, so workers only meet when balancing.
+class Thread_pool
+{
+public:
+    using Task = std::function<void()>;
+
+    // 0 threads uses every core
+    explicit Thread_pool(size_t threads = 0);
+
+    // finishes every submitted task first
+    ~Thread_pool();
+
+    Thread_pool(const Thread_pool&) = delete;
+    Thread_pool& operator=(const Thread_pool&) = delete;
+
+    // tasks are spread over the workers in turn, any thread may submit
+    void submit(Task task);
+
+    // block until every submitted task has run
+    void wait();
+
+    size_t size() const noexcept { return workers.size(); }
+
+private:
+    struct alignas(64) Worker_queue
+    {
+        std::mutex       mutex;
+        std::deque<Task> tasks;
+    };
+
+    void work(size_t index);
+    bool pop(size_t index, Task& task);
+    bool steal(size_t index, Task& task);
+
+    std::vector<std::unique_ptr<Worker_queue>> queues;
+    std::vector<std::thread>                   workers;
+    std::atomic<size_t>                        next_queue { 0 };
+
+    // only touched when a task is submitted, taken or finished, or a worker goes idle
+    std::atomic<size_t>     queued   { 0 }; // waiting in a deque
+    std::atomic<size_t>     pending  { 0 }; // submitted and not finished yet
+    std::atomic<bool>       stopping { false };
+    std::mutex              idle_mutex;
+    std::condition_variable idle;
+    std::condition_variable done;
+};
+
+#endif // THREAD_POOL_HPP
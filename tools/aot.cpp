@@ -0,0 +1,599 @@
+// chip8-aot: translates a ROM ahead of time into a C++ source file.
+//
+// Control flow is recovered from LOCATION_START, every recovered basic block
+// becomes a function working on the Chip8 state, and the generated entry point
+// falls back to the interpreter for indirect jumps and anything it didn't recover.
+
+#include "../chip8.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // What an instruction does to the control flow
+    enum class Kind
+    {
+        STRAIGHT,      // translated, continues with the next instruction
+        JUMP,          // 1NNN
+        CALL,          // 2NNN
+        RETURN,        // 00EE
+        JUMP_INDIRECT, // BNNN
+        SKIP,          // 3XKK, 4XKK, 5XY0, 9XY0
+        INTERPRETED,   // left to the interpreter, continues with the next instruction
+        SKIP_INTERPRETED, // EX9E, EXA1
+        ILLEGAL        // most likely data, recovery stops here
+    };
+
+    struct Options
+    {
+        std::string rom_path;
+        std::string output_path;
+        std::string name = "chip8_aot_run";
+        bool        with_main = false;
+    };
+
+    class Translator
+    {
+    public:
+        Translator(const std::vector<uint8_t>& rom);
+
+        void recover() noexcept;
+        void write(std::ostream& out, const Options& options) const;
+
+    private:
+        static Kind classify(uint16_t opcode) noexcept;
+
+        bool in_rom(uint16_t address) const noexcept;
+        uint16_t opcode_at(uint16_t address) const noexcept;
+
+        static std::string trap_condition(uint16_t opcode);
+        std::string translate(uint16_t address, uint16_t opcode) const;
+        void write_block(std::ostream& out, uint16_t leader, uint32_t& count) const;
+
+    private:
+        std::vector<uint8_t> memory;
+        size_t rom_size;
+
+        std::map<uint16_t, uint16_t> instructions; // address -> opcode
+        std::set<uint16_t>           leaders;
+    };
+
+    std::string register_name(unsigned index)
+    {
+        static constexpr char digits[] = "0123456789ABCDEF";
+        return std::string("V[0x") + digits[index & 0xF] + "]";
+    }
+
+    Translator::Translator(const std::vector<uint8_t>& rom)
+        : memory(MEMORY_SIZE, 0), rom_size(rom.size())
+    {
+        if(rom.size() > MEMORY_SIZE - Chip8::LOCATION_START)
+            throw std::length_error("ROM doesn't fit in memory!");
+
+        std::copy(rom.begin(), rom.end(), memory.begin() + Chip8::LOCATION_START);
+    }
+
+    // mirrors the masks of the interpreter's decode table
+    Kind Translator::classify(uint16_t opcode) noexcept
+    {
+        switch(opcode & 0xF000)
+        {
+            case 0x0000:
+            if((opcode & 0x000F) == 0x0)
+                return Kind::INTERPRETED;
+            if((opcode & 0x000F) == 0xE)
+                return Kind::RETURN;
+            return Kind::ILLEGAL;
+
+            case 0x1000: return Kind::JUMP;
+            case 0x2000: return Kind::CALL;
+
+            case 0x3000: case 0x4000:
+            case 0x5000: case 0x9000:
+            return Kind::SKIP;
+
+            case 0x6000: case 0x7000: case 0xA000:
+            return Kind::STRAIGHT;
+
+            case 0x8000:
+            switch(opcode & 0x000F)
+            {
+                case 0x0: case 0x1: case 0x2: case 0x3: case 0x4:
+                case 0x5: case 0x6: case 0x7: case 0xE:
+                return Kind::STRAIGHT;
+            }
+            return Kind::ILLEGAL;
+
+            case 0xB000: return Kind::JUMP_INDIRECT;
+
+            case 0xC000: case 0xD000:
+            return Kind::INTERPRETED;
+
+            case 0xE000:
+            if((opcode & 0x000F) == 0xE || (opcode & 0x000F) == 0x1)
+                return Kind::SKIP_INTERPRETED;
+            return Kind::ILLEGAL;
+
+            case 0xF000:
+            switch(opcode & 0x00FF)
+            {
+                case 0x1E: case 0x29: case 0x65:
+                return Kind::STRAIGHT;
+
+                case 0x07: case 0x0A: case 0x15:
+                case 0x18: case 0x33: case 0x55:
+                return Kind::INTERPRETED;
+            }
+            return Kind::ILLEGAL;
+        }
+
+        return Kind::ILLEGAL;
+    }
+
+    bool Translator::in_rom(uint16_t address) const noexcept
+    {
+        return address >= Chip8::LOCATION_START &&
+               address + 1u < Chip8::LOCATION_START + rom_size;
+    }
+
+    uint16_t Translator::opcode_at(uint16_t address) const noexcept {
+        return (memory[address] << 8) | memory[address + 1];
+    }
+
+    // Walk every statically reachable instruction and mark where blocks start
+    void Translator::recover() noexcept
+    {
+        std::vector<uint16_t> worklist { Chip8::LOCATION_START };
+        leaders.insert(Chip8::LOCATION_START);
+
+        // successors that start a new block
+        auto branch_to = [&](uint16_t target)
+        {
+            leaders.insert(target);
+            worklist.push_back(target);
+        };
+
+        while(not worklist.empty())
+        {
+            const uint16_t address = worklist.back();
+            worklist.pop_back();
+
+            if(not in_rom(address) || instructions.count(address))
+                continue;
+
+            const uint16_t opcode = opcode_at(address);
+            const uint16_t next   = address + Chip8::INSTRUCTION_LONG;
+            const uint16_t nnn    = opcode & 0xFFF;
+
+            instructions[address] = opcode;
+
+            switch(classify(opcode))
+            {
+                case Kind::STRAIGHT:
+                worklist.push_back(next);
+                break;
+
+                case Kind::JUMP:
+                branch_to(nnn);
+                break;
+
+                case Kind::CALL:
+                branch_to(nnn);
+                branch_to(next);
+                break;
+
+                case Kind::SKIP:
+                case Kind::SKIP_INTERPRETED:
+                branch_to(next);
+                branch_to(next + Chip8::INSTRUCTION_LONG);
+                break;
+
+                case Kind::INTERPRETED:
+                branch_to(next);
+                break;
+
+                // the target is only known at runtime
+                case Kind::RETURN:
+                case Kind::JUMP_INDIRECT:
+                case Kind::ILLEGAL:
+                break;
+            }
+        }
+    }
+
+    // when the instruction would raise a trap in the interpreter, empty if it never does
+    std::string Translator::trap_condition(uint16_t opcode)
+    {
+        std::ostringstream ss;
+        ss << std::hex << std::uppercase;
+
+        if((opcode & 0xF000) == 0x0000)
+            ss << "chip.sp == 0";
+        else if((opcode & 0xF000) == 0x2000)
+            ss << "chip.sp >= STACK_SIZE";
+        else if((opcode & 0xF0FF) == 0xF065)
+            ss << "chip.I + 0x" << ((opcode >> 8) & 0xF) << " >= MEMORY_SIZE";
+
+        return ss.str();
+    }
+
+    // C++ statements with the same semantics as the interpreter
+    std::string Translator::translate(uint16_t address, uint16_t opcode) const
+    {
+        std::ostringstream ss;
+        ss << std::hex << std::uppercase;
+
+        const unsigned nnn  = opcode & 0xFFF;
+        const unsigned x    = (opcode >> 8) & 0xF;
+        const unsigned y    = (opcode >> 4) & 0xF;
+        const unsigned kk   = opcode & 0xFF;
+        const unsigned next = address + Chip8::INSTRUCTION_LONG;
+        const unsigned skip = next + Chip8::INSTRUCTION_LONG;
+
+        const std::string Vx = register_name(x);
+        const std::string Vy = register_name(y);
+        const std::string VF = register_name(0xF);
+
+        switch(opcode & 0xF000)
+        {
+            case 0x0000: // 00EE
+            ss << "chip.sp--; chip.pc = chip.stack[chip.sp];";
+            break;
+
+            case 0x1000:
+            ss << "chip.pc = 0x" << nnn << ";";
+            break;
+
+            case 0x2000:
+            ss << "chip.stack[chip.sp] = 0x" << next << "; chip.sp++; chip.pc = 0x" << nnn << ";";
+            break;
+
+            case 0x3000:
+            ss << "chip.pc = " << Vx << " == 0x" << kk << " ? 0x" << skip << " : 0x" << next << ";";
+            break;
+
+            case 0x4000:
+            ss << "chip.pc = " << Vx << " != 0x" << kk << " ? 0x" << skip << " : 0x" << next << ";";
+            break;
+
+            case 0x5000:
+            ss << "chip.pc = " << Vx << " == " << Vy << " ? 0x" << skip << " : 0x" << next << ";";
+            break;
+
+            case 0x6000:
+            ss << Vx << " = 0x" << kk << ";";
+            break;
+
+            case 0x7000:
+            ss << Vx << " += 0x" << kk << ";";
+            break;
+
+            case 0x8000:
+            switch(opcode & 0x000F)
+            {
+                case 0x0: ss << Vx << " = "  << Vy << ";"; break;
+                case 0x1: ss << Vx << " |= " << Vy << ";"; break;
+                case 0x2: ss << Vx << " &= " << Vy << ";"; break;
+                case 0x3: ss << Vx << " ^= " << Vy << ";"; break;
+
+                case 0x4:
+                ss << "{ const uint16_t sum = " << Vx << " + " << Vy << "; "
+                   << VF << " = sum > 255; " << Vx << " = sum & 0xFF; }";
+                break;
+
+                case 0x5:
+                ss << VF << " = " << Vx << " > " << Vy << "; " << Vx << " -= " << Vy << ";";
+                break;
+
+                case 0x6:
+                ss << VF << " = " << Vx << " & 0x1; " << Vx << " >>= 1;";
+                break;
+
+                case 0x7:
+                ss << VF << " = " << Vy << " > " << Vx << "; " << Vx << " = " << Vy << " - " << Vx << ";";
+                break;
+
+                case 0xE:
+                ss << VF << " = (" << Vx << " & 0x80) >> 7; " << Vx << " <<= 1;";
+                break;
+            }
+            break;
+
+            case 0x9000:
+            ss << "chip.pc = " << Vx << " != " << Vy << " ? 0x" << skip << " : 0x" << next << ";";
+            break;
+
+            case 0xA000:
+            ss << "chip.I = 0x" << nnn << ";";
+            break;
+
+            case 0xB000:
+            ss << "chip.pc = V[0x0] + 0x" << nnn << ";";
+            break;
+
+            case 0xF000:
+            switch(opcode & 0x00FF)
+            {
+                case 0x1E: ss << "chip.I += " << Vx << ";"; break;
+                case 0x29: ss << "chip.I = "  << Vx << ";"; break;
+
+                case 0x65:
+                for(unsigned i = 0; i <= x; i++)
+                    ss << (i ? " " : "") << "V[0x" << i << "] = chip.memory[chip.I + 0x" << i << "];";
+                break;
+            }
+            break;
+        }
+
+        return ss.str();
+    }
+
+    // A block runs until a control transfer, an instruction left to
+    // the interpreter, or the start of another block. It returns how many
+    // instructions it executed, fewer than `count` when it stopped in front
+    // of one that traps so the interpreter can raise it
+    void Translator::write_block(std::ostream& out, uint16_t leader, uint32_t& count) const
+    {
+        std::ostringstream body;
+        body << std::hex << std::uppercase;
+
+        uint16_t address = leader;
+        bool transferred = false;
+        count = 0;
+
+        while(true)
+        {
+            const auto instruction = instructions.find(address);
+
+            if(instruction == instructions.end())
+                break;
+
+            const Kind kind = classify(instruction->second);
+
+            if(kind == Kind::INTERPRETED || kind == Kind::SKIP_INTERPRETED || kind == Kind::ILLEGAL)
+                break;
+
+            body << "        // 0x" << address << ": " << std::setw(4) << std::setfill('0')
+                 << instruction->second << std::setfill(' ') << "\n";
+
+            const std::string trap = trap_condition(instruction->second);
+            if(not trap.empty())
+                body << "        if(" << trap << ") { chip.pc = 0x" << address << "; return " << std::dec << count << std::hex << "; }\n";
+
+            body << "        " << translate(address, instruction->second) << "\n";
+            count++;
+
+            if(kind != Kind::STRAIGHT)
+            {
+                transferred = true;
+                break;
+            }
+
+            address += Chip8::INSTRUCTION_LONG;
+
+            if(leaders.count(address))
+                break;
+        }
+
+        if(count == 0)
+            return;
+
+        out << std::hex << std::uppercase;
+        out << "    uint32_t block_" << std::setw(3) << std::setfill('0') << leader << std::setfill(' ')
+            << "(Chip8& chip) noexcept\n"
+            << "    {\n"
+            << "        [[maybe_unused]] auto& V = chip.registers;\n\n"
+            << body.str();
+
+        if(not transferred)
+            out << std::hex << "        chip.pc = 0x" << address << ";\n";
+
+        out << std::dec << "        return " << count << ";\n"
+            << "    }\n\n";
+    }
+
+    void Translator::write(std::ostream& out, const Options& options) const
+    {
+        out << "// Generated by chip8-aot from " << options.rom_path << ", do not edit.\n"
+            << "#include \"chip8.hpp\"\n\n"
+            << "#include <cstddef>\n"
+            << "#include <cstdint>\n"
+            << "#include <cstring>\n";
+
+        if(options.with_main)
+            out << "#include <cstdlib>\n#include <iostream>\n";
+
+        out << "\nnamespace\n{\n";
+
+        // contiguous ranges of translated bytes
+        std::vector<std::pair<uint16_t, uint16_t>> ranges;
+        for(const auto& [address, opcode] : instructions)
+        {
+            const uint16_t end = address + Chip8::INSTRUCTION_LONG;
+
+            if(not ranges.empty() && address <= ranges.back().second)
+                ranges.back().second = std::max(ranges.back().second, end);
+            else
+                ranges.push_back({ address, end });
+        }
+
+        out << std::hex << std::uppercase << std::setfill('0');
+        out << "    // memory the blocks were translated from\n"
+            << "    struct Code_range { uint16_t begin; uint16_t end; };\n"
+            << "    constexpr Code_range code_ranges[] {\n";
+        for(const auto& [begin, end] : ranges)
+            out << "        { 0x" << std::setw(3) << begin << ", 0x" << std::setw(3) << end << " },\n";
+        out << "    };\n\n";
+
+        out << "    // the program as it was when it got translated\n"
+            << "    constexpr uint8_t image[] {";
+        for(size_t i = 0; i < rom_size; i++)
+        {
+            out << (i % 16 == 0 ? "\n        " : " ") << "0x" << std::setw(2)
+                << +memory[Chip8::LOCATION_START + i] << ",";
+        }
+        out << "\n    };\n\n" << std::setfill(' ');
+
+        out << "    bool code_intact(const Chip8& chip) noexcept\n"
+            << "    {\n"
+            << "        for(const auto& range : code_ranges)\n"
+            << "        {\n"
+            << "            const uint8_t* expected = image + (range.begin - Chip8::LOCATION_START);\n\n"
+            << "            if(std::memcmp(chip.memory.data() + range.begin, expected, range.end - range.begin) != 0)\n"
+            << "                return false;\n"
+            << "        }\n\n"
+            << "        return true;\n"
+            << "    }\n\n";
+
+        out << "    bool touches_code(size_t address, size_t length) noexcept\n"
+            << "    {\n"
+            << "        for(const auto& range : code_ranges)\n"
+            << "        {\n"
+            << "            if(address < range.end && address + length > range.begin)\n"
+            << "                return true;\n"
+            << "        }\n\n"
+            << "        return false;\n"
+            << "    }\n\n";
+
+        std::map<uint16_t, uint32_t> blocks;
+        for(const uint16_t leader : leaders)
+        {
+            uint32_t count = 0;
+            write_block(out, leader, count);
+
+            if(count > 0)
+                blocks[leader] = count;
+        }
+
+        out << "} // namespace\n\n";
+
+        out << "uint64_t " << options.name << "(Chip8& chip, uint64_t instructions) noexcept\n"
+            << "{\n"
+            << "    // the program changed its own code, the translation is no longer valid\n"
+            << "    if(not code_intact(chip))\n"
+            << "        return chip.run(instructions);\n\n"
+            << "    uint64_t executed = 0;\n\n"
+            << "    while(executed < instructions)\n"
+            << "    {\n"
+            << "        const uint64_t remaining = instructions - executed;\n\n"
+            << "        switch(chip.pc)\n"
+            << "        {\n";
+
+        for(const auto& [leader, count] : blocks)
+        {
+            out << std::hex << std::uppercase
+                << "            case 0x" << std::setw(3) << std::setfill('0') << leader << std::setfill(' ')
+                << ": if(remaining >= " << std::dec << count << ") { const uint32_t done = block_" << std::hex
+                << std::setw(3) << std::setfill('0') << leader << std::setfill(' ') << "(chip); executed += done; "
+                << "if(done == " << std::dec << count << ") continue; } break;\n";
+        }
+
+        out << "            default: break;\n"
+            << "        }\n\n"
+            << "        // indirect jumps, everything that wasn't translated and instructions that trap\n"
+            << "        chip.cycle();\n"
+            << "        executed++;\n\n"
+            << "        const uint16_t opcode = chip.opcode & 0xF0FF;\n"
+            << "        if(opcode == 0xF033 || opcode == 0xF055)\n"
+            << "        {\n"
+            << "            const size_t length = opcode == 0xF033 ? 3 : ((chip.opcode >> 8) & 0xF) + 1;\n\n"
+            << "            if(touches_code(chip.I, length) && not code_intact(chip))\n"
+            << "            {\n"
+            << "                chip.add_cycles(executed);\n"
+            << "                return executed + chip.run(instructions - executed);\n"
+            << "            }\n"
+            << "        }\n"
+            << "    }\n\n"
+            << "    // run() didn't see any of these\n"
+            << "    chip.add_cycles(executed);\n"
+            << "    return executed;\n"
+            << "}\n";
+
+        if(options.with_main)
+        {
+            out << "\n"
+                << "int main(int argc, char* argv[])\n"
+                << "{\n"
+                << "    if(argc != 3)\n"
+                << "    {\n"
+                << "        std::cerr << \"Usage: \" << argv[0] << \" <rom> <instructions>\\n\";\n"
+                << "        return EXIT_FAILURE;\n"
+                << "    }\n\n"
+                << "    Chip8 chip(argv[1]);\n"
+                << "    const uint64_t executed = " << options.name << "(chip, std::strtoull(argv[2], nullptr, 10));\n\n"
+                << "    std::cout << \"executed \" << executed << \" instructions, pc = 0x\" << std::hex << chip.pc << \"\\n\";\n"
+                << "    for(size_t i = 0; i < chip.registers.size(); i++)\n"
+                << "        std::cout << \"V\" << i << \" = 0x\" << +chip.registers[i] << \"\\n\";\n\n"
+                << "    return EXIT_SUCCESS;\n"
+                << "}\n";
+        }
+    }
+
+    std::vector<uint8_t> read_rom(const std::string& path)
+    {
+        std::ifstream file(path, std::ifstream::binary | std::ifstream::in);
+
+        if(not file.is_open())
+            throw std::invalid_argument("Path is invalid!");
+
+        return std::vector<uint8_t>(std::istreambuf_iterator<char>(file),
+                                    std::istreambuf_iterator<char>());
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    std::vector<std::string> positional;
+
+    for(int i = 1; i < argc; i++)
+    {
+        const std::string argument = argv[i];
+
+        if(argument == "--name" && i + 1 < argc)
+            options.name = argv[++i];
+        else if(argument == "--main")
+            options.with_main = true;
+        else
+            positional.push_back(argument);
+    }
+
+    if(positional.size() != 2)
+    {
+        std::cerr << "Usage: chip8-aot <rom> <output.cpp> [--name function] [--main]\n";
+        return EXIT_FAILURE;
+    }
+
+    options.rom_path    = positional[0];
+    options.output_path = positional[1];
+
+    try
+    {
+        Translator translator(read_rom(options.rom_path));
+        translator.recover();
+
+        std::ofstream output(options.output_path);
+        if(not output.is_open())
+            throw std::invalid_argument("Output path is invalid!");
+
+        translator.write(output, options);
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,192 @@
+// chip8-batch: runs many headless machines across every core.
+//
+// Every ROM is run once per seed, each job stops at a cycle or frame budget
+// and reports its final state hash and throughput.
+
+#include "../chip8.hpp"
+#include "../headless.hpp"
+#include "../rom.hpp"
+#include "../thread_pool.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct Options
+    {
+        std::vector<std::string> rom_paths;
+        uint64_t         first_seed = 0;
+        uint64_t         seeds      = 1;
+        size_t           threads    = 0;
+        bool             jit        = false;
+        Headless_options run;
+    };
+
+    struct Job
+    {
+        size_t   rom;
+        uint64_t seed;
+    };
+
+    // every job writes its own slot, nothing is shared while running
+    struct alignas(64) Job_result
+    {
+        uint64_t        hash = 0;
+        Headless_result run;
+        std::string     error;
+    };
+
+    void print_usage()
+    {
+        std::cerr << "Usage: chip8-batch [options] <rom>...\n"
+                  << "  --cycles <n>      stop every job after n instructions\n"
+                  << "  --frames <n>      stop every job after n frames\n"
+                  << "  --clock <hz>      instructions per emulated second (default 500)\n"
+                  << "  --seeds <n>       run every ROM with n seeds (default 1)\n"
+                  << "  --first-seed <n>  first seed of every ROM (default 0)\n"
+                  << "  --threads <n>     number of workers (default every core)\n"
+                  << "  --jit             use the JIT backend\n";
+    }
+
+    bool parse_options(int argc, char* argv[], Options& options)
+    {
+        for(int i = 1; i < argc; i++)
+        {
+            const std::string argument = argv[i];
+            const bool has_value = i + 1 < argc;
+
+            if(argument == "--cycles" && has_value)
+                options.run.instructions = std::strtoull(argv[++i], nullptr, 10);
+            else if(argument == "--frames" && has_value)
+                options.run.frames = std::strtoull(argv[++i], nullptr, 10);
+            else if(argument == "--clock" && has_value)
+                options.run.clock = std::strtoull(argv[++i], nullptr, 10);
+            else if(argument == "--seeds" && has_value)
+                options.seeds = std::strtoull(argv[++i], nullptr, 10);
+            else if(argument == "--first-seed" && has_value)
+                options.first_seed = std::strtoull(argv[++i], nullptr, 10);
+            else if(argument == "--threads" && has_value)
+                options.threads = std::strtoull(argv[++i], nullptr, 10);
+            else if(argument == "--jit")
+                options.jit = true;
+            else if(argument.rfind("--", 0) != 0)
+                options.rom_paths.push_back(argument);
+            else
+                return false;
+        }
+
+        if(options.run.instructions == 0 && options.run.frames == 0)
+            return false;
+
+        return options.run.clock > 0 && options.seeds > 0 && not options.rom_paths.empty();
+    }
+
+    void run_job(const Chip8& warm, uint64_t seed, const Options& options, Job_result& result) noexcept
+    {
+        try
+        {
+            // a fork of the loaded machine is a copy, no file or allocation per job
+            Chip8 chip = warm.fork();
+            chip.seed(seed);
+
+            if(options.jit)
+                chip.set_backend(Chip8::Backend::JIT);
+
+            result.run  = run_headless(chip, options.run);
+            result.hash = chip.state_hash();
+        }
+        catch(const std::exception& e)
+        {
+            result.error = e.what();
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if(not parse_options(argc, argv, options))
+    {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        // one loaded machine per ROM, every job forks it
+        std::vector<std::unique_ptr<Chip8>> machines;
+        for(const std::string& path : options.rom_paths)
+            machines.push_back(std::make_unique<Chip8>(Rom_file(path)));
+
+        std::vector<Job> jobs;
+        for(size_t rom = 0; rom < machines.size(); rom++)
+        {
+            for(uint64_t seed = options.first_seed; seed < options.first_seed + options.seeds; seed++)
+                jobs.push_back({ rom, seed });
+        }
+
+        std::vector<Job_result> results(jobs.size());
+        const auto start = std::chrono::steady_clock::now();
+
+        {
+            Thread_pool pool(options.threads);
+            for(size_t i = 0; i < jobs.size(); i++)
+            {
+                pool.submit([&, i]
+                {
+                    run_job(*machines[jobs[i].rom], jobs[i].seed, options, results[i]);
+                });
+            }
+
+            pool.wait();
+            options.threads = pool.size();
+        }
+
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << "rom\tseed\thash\tinstructions\tframes\tM instructions/s\n";
+
+        uint64_t total_instructions = 0;
+        int status = EXIT_SUCCESS;
+
+        for(size_t i = 0; i < jobs.size(); i++)
+        {
+            const Job_result& result = results[i];
+            std::cout << options.rom_paths[jobs[i].rom] << "\t" << jobs[i].seed << "\t";
+
+            if(not result.error.empty())
+            {
+                std::cout << "error: " << result.error << "\n";
+                status = EXIT_FAILURE;
+                continue;
+            }
+
+            const double per_second = result.run.seconds > 0 ? result.run.instructions / result.run.seconds : 0;
+
+            std::cout << std::hex << std::setw(16) << std::setfill('0') << result.hash << std::dec << std::setfill(' ')
+                      << "\t" << result.run.instructions << "\t" << result.run.frames << "\t"
+                      << std::fixed << std::setprecision(1) << per_second / 1e6 << std::defaultfloat << "\n";
+
+            total_instructions += result.run.instructions;
+        }
+
+        std::cout << "jobs: " << jobs.size() << " threads: " << options.threads
+                  << " time: " << std::fixed << std::setprecision(3) << seconds * 1000 << " ms, "
+                  << std::setprecision(1) << (seconds > 0 ? total_instructions / seconds : 0) / 1e6
+                  << " M instructions/s\n";
+
+        return status;
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,362 @@
+// chip8_bench: measures the interpreter to catch regressions between versions.
+//
+// Decoding is timed over every 16-bit opcode. Synthetic ROMs, generated from
+// a fixed seed, stress one kind of instruction each and are run with the
+// decode cache off, on, with fusion and on the JIT, translated by chip8-aot,
+// as a lockstep group next to the same number of forks, and as a batch of
+// forks on a thread pool. ROMs given on the command line are run headless.
+// Every result is reported in operations per second.
+
+#include "../chip8.hpp"
+#include "../headless.hpp"
+#include "../lockstep.hpp"
+#include "../thread_pool.hpp"
+#include "bench_roms.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// generated from the synthetic ROMs by chip8-aot at build time
+uint64_t chip8_aot_alu(Chip8& chip, uint64_t instructions) noexcept;
+uint64_t chip8_aot_branch(Chip8& chip, uint64_t instructions) noexcept;
+uint64_t chip8_aot_memory(Chip8& chip, uint64_t instructions) noexcept;
+uint64_t chip8_aot_draw(Chip8& chip, uint64_t instructions) noexcept;
+uint64_t chip8_aot_mixed(Chip8& chip, uint64_t instructions) noexcept;
+
+namespace
+{
+    struct Options
+    {
+        std::vector<std::string> rom_paths;
+        uint64_t instructions = 10'000'000;
+        uint64_t repeats      = 3;
+        uint64_t clock        = Scheduler::DEFAULT_CLOCK;
+        bool     json         = false;
+    };
+
+    struct Result
+    {
+        std::string name;
+        uint64_t    operations;
+        double      seconds;
+    };
+
+    void print_usage()
+    {
+        std::cerr << "Usage: chip8_bench [options] [rom]...\n"
+                  << "  --instructions <n>  instructions per run (default 10000000)\n"
+                  << "  --repeats <n>       runs per benchmark, the fastest is kept (default 3)\n"
+                  << "  --clock <hz>        clock of the ROM runs (default 500)\n"
+                  << "  --json              print the results as JSON\n";
+    }
+
+    bool parse_options(int argc, char* argv[], Options& options)
+    {
+        for(int i = 1; i < argc; i++)
+        {
+            const std::string argument = argv[i];
+            const bool has_value = i + 1 < argc;
+
+            if(argument == "--instructions" && has_value)
+                options.instructions = std::strtoull(argv[++i], nullptr, 10);
+            else if(argument == "--repeats" && has_value)
+                options.repeats = std::strtoull(argv[++i], nullptr, 10);
+            else if(argument == "--clock" && has_value)
+                options.clock = std::strtoull(argv[++i], nullptr, 10);
+            else if(argument == "--json")
+                options.json = true;
+            else if(argument.rfind("--", 0) != 0)
+                options.rom_paths.push_back(argument);
+            else
+                return false;
+        }
+
+        return options.instructions > 0 && options.repeats > 0 && options.clock > 0;
+    }
+
+    // the fastest of every repeat, `run` returns the operations it did
+    Result measure(const std::string& name, const Options& options, const std::function<uint64_t()>& run)
+    {
+        Result best { name, 0, 0 };
+        for(uint64_t i = 0; i < options.repeats; i++)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            const uint64_t operations = run();
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            if(best.operations == 0 || seconds * best.operations < best.seconds * operations)
+                best = { name, operations, seconds };
+        }
+
+        return best;
+    }
+
+    // the decode sum goes here so the loop isn't optimized away
+    volatile size_t decode_sink = 0;
+
+    Result bench_decode(const Options& options)
+    {
+        return measure("decode", options, [&]
+        {
+            size_t sum = 0;
+            uint64_t decoded = 0;
+            while(decoded < options.instructions)
+            {
+                for(uint32_t opcode = 0; opcode <= 0xFFFF; opcode++)
+                    sum += Chip8::get_opcode_class(static_cast<uint16_t>(opcode));
+
+                decoded += 0x10000;
+            }
+
+            decode_sink = sum;
+            return decoded;
+        });
+    }
+
+    struct Configuration
+    {
+        const char* name;
+        bool cache;
+        bool fusion;
+        bool jit;
+    };
+
+    constexpr Configuration CONFIGURATIONS[] = {
+        { "uncached", false, false, false },
+        { "cached",   true,  false, false },
+        { "fused",    true,  true,  false },
+        { "jit",      true,  true,  true  }
+    };
+
+    void bench_synthetic(const Options& options, std::vector<Result>& results)
+    {
+        for(const Workload& workload : make_workloads())
+        {
+            for(const Configuration& configuration : CONFIGURATIONS)
+            {
+                const std::string name = std::string("synthetic/") + workload.name + "/" + configuration.name;
+
+                Chip8 chip(workload.rom.data(), workload.rom.size());
+                chip.seed(0);
+                chip.set_decode_cache(configuration.cache);
+                chip.set_fusion(configuration.fusion);
+
+                if(configuration.jit)
+                {
+                    try
+                    {
+                        chip.set_backend(Chip8::Backend::JIT);
+                    }
+                    catch(const std::runtime_error&)
+                    {
+                        continue;
+                    }
+                }
+
+                results.push_back(measure(name, options, [&] { return chip.run(options.instructions); }));
+            }
+        }
+    }
+
+    // the same instructions spread over LOCKSTEP_LANES machines, once as a
+    // lockstep group and once as independent forks for comparison
+    enum { LOCKSTEP_LANES = 16 };
+
+    void bench_lockstep(const Options& options, std::vector<Result>& results)
+    {
+        const uint64_t steps = std::max<uint64_t>(options.instructions / LOCKSTEP_LANES, 1);
+
+        for(const Workload& workload : make_workloads())
+        {
+            const std::string name = std::string("lockstep/") + workload.name;
+
+            Chip8 chip(workload.rom.data(), workload.rom.size());
+            chip.seed(0);
+
+            Lockstep_group<LOCKSTEP_LANES> group(chip, 0);
+            results.push_back(measure(name + "/group", options, [&] { return group.run(steps); }));
+
+            std::vector<Chip8> forks;
+            for(size_t lane = 0; lane < LOCKSTEP_LANES; lane++)
+            {
+                forks.push_back(chip.fork());
+                forks.back().seed(lane);
+            }
+
+            results.push_back(measure(name + "/forks", options, [&]
+            {
+                uint64_t executed = 0;
+                for(Chip8& fork : forks)
+                    executed += fork.run(steps);
+
+                return executed;
+            }));
+        }
+    }
+
+    struct Aot_program
+    {
+        const char* name;
+        uint64_t (*run)(Chip8& chip, uint64_t instructions) noexcept;
+    };
+
+    constexpr Aot_program AOT_PROGRAMS[] = {
+        { "alu",    chip8_aot_alu    },
+        { "branch", chip8_aot_branch },
+        { "memory", chip8_aot_memory },
+        { "draw",   chip8_aot_draw   },
+        { "mixed",  chip8_aot_mixed  }
+    };
+
+    void bench_aot(const Options& options, std::vector<Result>& results)
+    {
+        for(const Workload& workload : make_workloads())
+        {
+            const auto program = std::find_if(std::begin(AOT_PROGRAMS), std::end(AOT_PROGRAMS),
+                                              [&](const Aot_program& aot) { return std::strcmp(aot.name, workload.name) == 0; });
+            if(program == std::end(AOT_PROGRAMS))
+                continue;
+
+            Chip8 chip(workload.rom.data(), workload.rom.size());
+            chip.seed(0);
+
+            results.push_back(measure(std::string("aot/") + workload.name, options, [&]
+            {
+                return program->run(chip, options.instructions);
+            }));
+        }
+    }
+
+    // the same instructions spread over BATCH_MACHINES forks, run on every core
+    enum { BATCH_MACHINES = 64 };
+
+    void bench_batch(const Options& options, std::vector<Result>& results)
+    {
+        const uint64_t steps = std::max<uint64_t>(options.instructions / BATCH_MACHINES, 1);
+        Thread_pool pool;
+
+        for(const Workload& workload : make_workloads())
+        {
+            Chip8 chip(workload.rom.data(), workload.rom.size());
+
+            std::vector<Chip8> forks;
+            for(size_t machine = 0; machine < BATCH_MACHINES; machine++)
+            {
+                forks.push_back(chip.fork());
+                forks.back().seed(machine);
+            }
+
+            std::vector<uint64_t> executed(BATCH_MACHINES);
+            results.push_back(measure(std::string("batch/") + workload.name, options, [&]
+            {
+                for(size_t machine = 0; machine < BATCH_MACHINES; machine++)
+                    pool.submit([&, machine] { executed[machine] = forks[machine].run(steps); });
+
+                pool.wait();
+
+                uint64_t total = 0;
+                for(uint64_t count : executed)
+                    total += count;
+
+                return total;
+            }));
+        }
+    }
+
+    void bench_roms(const Options& options, std::vector<Result>& results)
+    {
+        for(const std::string& path : options.rom_paths)
+        {
+            const Chip8 loaded(path);
+
+            Headless_options run;
+            run.instructions = options.instructions;
+            run.clock        = options.clock;
+
+            results.push_back(measure("rom/" + path, options, [&]
+            {
+                Chip8 chip = loaded.fork();
+                chip.seed(0);
+
+                return run_headless(chip, run).instructions;
+            }));
+        }
+    }
+
+    // names are paths at worst, only quotes and backslashes need escaping
+    std::string escape(const std::string& text)
+    {
+        std::string escaped;
+        for(char c : text)
+        {
+            if(c == '"' || c == '\\')
+                escaped += '\\';
+            escaped += c;
+        }
+
+        return escaped;
+    }
+
+    void print_results(const std::vector<Result>& results, bool json)
+    {
+        if(json)
+        {
+            std::cout << "{\n  \"version\": 1,\n  \"results\": [";
+            for(size_t i = 0; i < results.size(); i++)
+            {
+                const Result& result = results[i];
+                std::cout << (i > 0 ? "," : "") << "\n    { \"name\": \"" << escape(result.name)
+                          << "\", \"operations\": " << result.operations
+                          << ", \"seconds\": " << result.seconds
+                          << ", \"per_second\": " << result.operations / result.seconds << " }";
+            }
+            std::cout << "\n  ]\n}\n";
+            return;
+        }
+
+        std::cout << std::fixed << std::setprecision(1);
+        for(const Result& result : results)
+        {
+            std::cout << std::left << std::setw(32) << result.name << std::right
+                      << std::setw(10) << result.operations / result.seconds / 1e6 << " M/s\n";
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if(not parse_options(argc, argv, options))
+    {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        std::vector<Result> results;
+        results.push_back(bench_decode(options));
+        bench_synthetic(options, results);
+        bench_aot(options, results);
+        bench_lockstep(options, results);
+        bench_batch(options, results);
+        bench_roms(options, results);
+
+        print_results(results, options.json);
+    }
+    catch(const std::exception& error)
+    {
+        std::cerr << error.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,34 @@
+// chip8_bench_roms: writes the synthetic ROMs of chip8_bench as <directory>/bench_<name>.ch8
+// so chip8-aot can translate them at build time.
+
+#include "bench_roms.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+int main(int argc, char* argv[])
+{
+    if(argc != 2)
+    {
+        std::cerr << "Usage: chip8_bench_roms <directory>\n";
+        return EXIT_FAILURE;
+    }
+
+    for(const Workload& workload : make_workloads())
+    {
+        const std::string path = std::string(argv[1]) + "/bench_" + workload.name + ".ch8";
+
+        std::ofstream rom(path, std::ofstream::binary);
+        rom.write(reinterpret_cast<const char*>(workload.rom.data()), workload.rom.size());
+
+        if(not rom)
+        {
+            std::cerr << "Could not write " << path << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
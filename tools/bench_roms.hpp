@@ -0,0 +1,135 @@
+#ifndef BENCH_ROMS_HPP
+#define BENCH_ROMS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The synthetic ROMs of chip8_bench, shared with chip8_bench_roms which
+// writes them out for chip8-aot to translate at build time.
+
+// the generator is part of the benchmark, the ROMs must not change between versions
+class Rom_builder
+{
+public:
+    uint32_t random(uint32_t bound) noexcept
+    {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return static_cast<uint32_t>(state >> 33) % bound;
+    }
+
+    uint8_t reg() noexcept { return static_cast<uint8_t>(random(15)); }
+
+    void emit(uint16_t opcode)
+    {
+        words.push_back(opcode);
+    }
+
+    // the body loops forever, a skip never jumps over the loop
+    std::vector<uint8_t> finish()
+    {
+        emit(0x6000);
+        emit(0x1200);
+
+        std::vector<uint8_t> rom;
+        for(uint16_t word : words)
+        {
+            rom.push_back(static_cast<uint8_t>(word >> 8));
+            rom.push_back(static_cast<uint8_t>(word & 0xFF));
+        }
+
+        return rom;
+    }
+
+private:
+    uint64_t state = 0x5EED;
+    std::vector<uint16_t> words;
+};
+
+enum { BODY_LENGTH = 64 };
+
+inline void emit_alu(Rom_builder& rom)
+{
+    static constexpr uint16_t ALU[] = { 0x8000, 0x8001, 0x8002, 0x8003, 0x8004, 0x8005, 0x8006, 0x8007, 0x800E };
+
+    const uint16_t x = rom.reg(), y = rom.reg();
+    switch(rom.random(3))
+    {
+    case 0:  rom.emit(0x6000 | x << 8 | rom.random(256)); break;
+    case 1:  rom.emit(0x7000 | x << 8 | rom.random(256)); break;
+    default: rom.emit(ALU[rom.random(9)] | x << 8 | y << 4); break;
+    }
+}
+
+inline void emit_branch(Rom_builder& rom)
+{
+    const uint16_t x = rom.reg(), y = rom.reg();
+    switch(rom.random(5))
+    {
+    case 0:  rom.emit(0x3000 | x << 8 | rom.random(4)); break;
+    case 1:  rom.emit(0x4000 | x << 8 | rom.random(4)); break;
+    case 2:  rom.emit(0x5000 | x << 8 | y << 4); break;
+    case 3:  rom.emit(0x9000 | x << 8 | y << 4); break;
+    default: rom.emit(0x7000 | x << 8 | 1); break;
+    }
+}
+
+// everything lands in 0xE00 and after, far from the code
+inline void emit_memory(Rom_builder& rom)
+{
+    static constexpr uint16_t MEMORY[] = { 0xF033, 0xF055, 0xF065, 0xF01E };
+
+    rom.emit(0xAE00);
+    rom.emit(MEMORY[rom.random(4)] | rom.reg() << 8);
+}
+
+// a font sprite somewhere on the screen
+inline void emit_draw(Rom_builder& rom)
+{
+    const uint16_t x = rom.reg(), y = rom.reg();
+
+    rom.emit(0xA000 | rom.random(16) * 5);
+    rom.emit(0x6000 | x << 8 | rom.random(64));
+    rom.emit(0x6000 | y << 8 | rom.random(32));
+    rom.emit(0xD000 | x << 8 | y << 4 | (rom.random(5) + 1));
+}
+
+inline std::vector<uint8_t> make_rom(void (*emit)(Rom_builder&))
+{
+    Rom_builder rom;
+    for(size_t i = 0; i < BODY_LENGTH; i++)
+        emit(rom);
+
+    return rom.finish();
+}
+
+inline std::vector<uint8_t> make_mixed_rom()
+{
+    static constexpr void (*EMITTERS[])(Rom_builder&) = { emit_alu, emit_alu, emit_branch, emit_memory, emit_draw };
+
+    Rom_builder rom;
+    for(size_t i = 0; i < BODY_LENGTH; i++)
+        EMITTERS[rom.random(5)](rom);
+
+    return rom.finish();
+}
+
+struct Workload
+{
+    const char* name;
+    std::vector<uint8_t> rom;
+};
+
+// the names are also listed in CMakeLists.txt, which translates every workload with chip8-aot
+inline std::vector<Workload> make_workloads()
+{
+    return {
+        { "alu",    make_rom(emit_alu)    },
+        { "branch", make_rom(emit_branch) },
+        { "memory", make_rom(emit_memory) },
+        { "draw",   make_rom(emit_draw)   },
+        { "mixed",  make_mixed_rom()      }
+    };
+}
+
+#endif // BENCH_ROMS_HPP
@@ -0,0 +1,101 @@
+// chip8-trace-dump: prints a binary trace written with --trace.
+//
+// One line per executed instruction: the cycle, the address, the opcode,
+// the register it changed and the value of I afterwards.
+
+#include "../tracer.hpp"
+
+#include <cstdlib>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+namespace
+{
+    struct Options
+    {
+        std::string path;
+        uint64_t    first_cycle = 0;
+        uint64_t    limit       = UINT64_MAX;
+        bool        has_pc      = false;
+        uint16_t    pc          = 0;
+    };
+
+    void print_usage()
+    {
+        std::cerr << "Usage: chip8-trace-dump [options] <trace>\n"
+                  << "  --from <n>        start at cycle n\n"
+                  << "  --limit <n>       print at most n records\n"
+                  << "  --pc <address>    only print records at this address, 0x prefix for hex\n";
+    }
+
+    bool parse_options(int argc, char* argv[], Options& options)
+    {
+        for(int i = 1; i < argc; i++)
+        {
+            const std::string argument = argv[i];
+            const bool has_value = i + 1 < argc;
+
+            if(argument == "--from" && has_value)
+                options.first_cycle = std::strtoull(argv[++i], nullptr, 10);
+            else if(argument == "--limit" && has_value)
+                options.limit = std::strtoull(argv[++i], nullptr, 10);
+            else if(argument == "--pc" && has_value)
+            {
+                options.has_pc = true;
+                options.pc     = static_cast<uint16_t>(std::strtoul(argv[++i], nullptr, 0));
+            }
+            else if(options.path.empty() && argument.rfind("--", 0) != 0)
+                options.path = argument;
+            else
+                return false;
+        }
+
+        return not options.path.empty();
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if(not parse_options(argc, argv, options))
+    {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        Trace_reader reader(options.path);
+
+        std::cout << std::setfill('0');
+
+        Trace_record record;
+        uint64_t printed = 0;
+        while(printed < options.limit && reader.next(record))
+        {
+            if(record.cycle < options.first_cycle || (options.has_pc && record.pc != options.pc))
+                continue;
+
+            std::cout << std::dec << std::setw(10) << record.cycle
+                      << std::hex << "  0x" << std::setw(3) << record.pc
+                      << "  " << std::setw(4) << record.opcode;
+
+            if(record.reg != Trace_record::NO_REGISTER)
+                std::cout << "  V" << +record.reg << "=" << std::setw(2) << +record.value;
+            else
+                std::cout << "      ";
+
+            std::cout << "  I=" << std::setw(3) << record.I << "\n";
+            printed++;
+        }
+    }
+    catch(const std::exception& error)
+    {
+        std::cerr << error.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,94 @@
+#include "tracer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <exception>
+#include <stdexcept>
+
+#include "byte_order.hpp"
+
+namespace
+{
+    constexpr char MAGIC[4] = { 'C', '8', 'T', 'R' };
+
+    constexpr size_t RECORD_BYTES = sizeof(Trace_record);
+
+    // records drained and written at once
+    constexpr size_t BATCH_SIZE = 4096;
+}
+
+Tracer::Tracer(const std::string& path)
+    : file(path, std::ofstream::binary | std::ofstream::out)
+{
+    if(not file.is_open())
+        throw std::invalid_argument("Trace path is invalid!");
+
+    uint8_t header[sizeof(MAGIC) + 2];
+    std::copy(MAGIC, MAGIC + sizeof(MAGIC), header);
+    put_le<uint16_t>(header + sizeof(MAGIC), VERSION);
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+    bytes.resize(BATCH_SIZE * RECORD_BYTES);
+    ring.start(BATCH_SIZE, [this](const Trace_record* records, size_t count) { write_batch(records, count); },
+               nullptr, [this] { file.flush(); });
+}
+
+Tracer::~Tracer()
+{
+    ring.stop();
+}
+
+void Tracer::write_batch(const Trace_record* records, size_t count)
+{
+    uint8_t* out = bytes.data();
+    for(size_t i = 0; i < count; i++)
+    {
+        const Trace_record& record = records[i];
+
+        out = put_le(out, record.cycle);
+        out = put_le(out, record.pc);
+        out = put_le(out, record.opcode);
+        out = put_le(out, record.reg);
+        out = put_le(out, record.value);
+        out = put_le(out, record.I);
+    }
+
+    file.write(reinterpret_cast<const char*>(bytes.data()), out - bytes.data());
+}
+
+Trace_reader::Trace_reader(const std::string& path)
+    : file(path, std::ifstream::binary | std::ifstream::in)
+{
+    if(not file.is_open())
+        throw std::invalid_argument("Trace path is invalid!");
+
+    uint8_t header[sizeof(MAGIC) + 2] { };
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+
+    uint16_t version = 0;
+    get_le(header + sizeof(MAGIC), version);
+
+    if(not file || not std::equal(MAGIC, MAGIC + sizeof(MAGIC), header) || version != Tracer::VERSION)
+        throw std::runtime_error("File is not a trace!");
+}
+
+bool Trace_reader::next(Trace_record& record)
+{
+    std::array<uint8_t, RECORD_BYTES> bytes;
+    file.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+
+    if(file.gcount() == 0)
+        return false;
+    if(static_cast<size_t>(file.gcount()) != bytes.size())
+        throw std::runtime_error("Trace is truncated!");
+
+    const uint8_t* in = bytes.data();
+    in = get_le(in, record.cycle);
+    in = get_le(in, record.pc);
+    in = get_le(in, record.opcode);
+    in = get_le(in, record.reg);
+    in = get_le(in, record.value);
+    get_le(in, record.I);
+
+    return true;
+}
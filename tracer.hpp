@@ -0,0 +1,77 @@
+#ifndef TRACER_HPP
+#define TRACER_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ring_writer.hpp"
+
+// One executed instruction, 16 bytes in memory and in the file
+struct Trace_record
+{
+    enum : uint8_t { NO_REGISTER = 0xFF };
+
+    uint64_t cycle;
+    uint16_t pc;       // where the instruction was fetched from
+    uint16_t opcode;
+    uint8_t  reg;      // the first register the instruction changed, or NO_REGISTER
+    uint8_t  value;    // its new value
+    uint16_t I;        // I after the instruction
+};
+
+static_assert(sizeof(Trace_record) == 16, "trace records are 16 bytes");
+
+// Traces are little-endian: "C8TR", uint16 version, then the records
+// as laid out above, field by field.
+// The emulation thread pushes records into a ring, a thread of the tracer
+// drains the ring to the file so the emulation never waits on a write.
+class Tracer
+{
+public:
+    enum { VERSION = 1 };
+
+    // throws when the file can't be created
+    explicit Tracer(const std::string& path);
+
+    // writes every record still in the ring and closes the file
+    ~Tracer();
+
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    // only called from the emulation thread,
+    // waits for the writer when the ring is full so no record is lost
+    void record(const Trace_record& record) noexcept { ring.push(record); }
+
+    // how many times record() found the ring full
+    uint64_t get_stalls() const noexcept { return ring.get_stalls(); }
+
+private:
+    enum { RING_SIZE = 1 << 16 };
+
+    void write_batch(const Trace_record* records, size_t count);
+
+    std::ofstream        file;
+    std::vector<uint8_t> bytes;
+
+    Ring_writer<Trace_record, RING_SIZE> ring;
+};
+
+// Reads back a trace written by Tracer
+class Trace_reader
+{
+public:
+    // throws when the file is missing or isn't a trace
+    explicit Trace_reader(const std::string& path);
+
+    // returns false at the end of the trace, throws on a truncated record
+    bool next(Trace_record& record);
+
+private:
+    std::ifstream file;
+};
+
+#endif // TRACER_HPP
@@ -0,0 +1,51 @@
+#ifndef TRIPLE_BUFFER_HPP
+#define TRIPLE_BUFFER_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Lock-free handoff between one writer and one reader.
+// The writer always has a buffer to fill, the reader always sees
+// the latest published one, and nobody ever waits for the other.
+template<typename T>
+class Triple_buffer
+{
+public:
+    // the buffer the writer fills, only valid until publish()
+    T& write_buffer() noexcept { return buffers[back]; }
+
+    // hand the filled buffer to the reader, replacing any frame it hasn't read yet
+    void publish() noexcept {
+        back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    // take the latest published buffer, returns false when nothing new was published
+    bool update() noexcept
+    {
+        if((middle.load(std::memory_order_relaxed) & FRESH) == 0)
+            return false;
+
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+    // the buffer the reader took with the last update()
+    const T& read_buffer() const noexcept { return buffers[front]; }
+
+private:
+    enum : uint8_t
+    {
+        INDEX = 0x3, // which buffer is in the middle
+        FRESH = 0x4  // set when the middle buffer hasn't been read yet
+    };
+
+    std::array<T, 3> buffers { };
+
+    // writer, middle and reader don't share cache lines
+    alignas(64) uint8_t              back   = 0;
+    alignas(64) std::atomic<uint8_t> middle { 1 };
+    alignas(64) uint8_t              front  = 2;
+};
+
+#endif // TRIPLE_BUFFER_HPP
@@ -1,12 +1,15 @@
 #include "window.hpp"
 
+#include <algorithm>
 #include <exception>
 #include <iostream>
-#include <map>
 
 Window::Window(const std::string& str, int width, int height, int chip_width, int chip_height)
-    : m_chip_width(chip_width)
+    : m_chip_width(chip_width), m_chip_height(chip_height)
 {
+    if(chip_height > 32)
+        throw std::invalid_argument("Window can't track more than 32 dirty rows!");
+
     // Initialize SDL
     if(SDL_Init(SDL_INIT_VIDEO) < 0)
     {
@@ -26,46 +29,109 @@ Window::Window(const std::string& str, int width, int height, int chip_width, in
     texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, chip_width, chip_height);
 }
 
-void Window::event_handler(std::array<uint8_t, 16>& keypads) noexcept
+void Window::event_handler(Input_queue& input) noexcept
 {
-    // which index the key is
-    static std::map<uint8_t, SDL_Keycode> Keys {
-        { 0,   SDLK_x }, { 1,  SDLK_1  }, { 2,   SDLK_2  },
-        { 3,   SDLK_3 }, { 4,  SDLK_q  }, { 5,   SDLK_w  },
-        { 6,   SDLK_e }, { 7,  SDLK_a  }, { 8,   SDLK_s  },
-        { 9,   SDLK_d }, { 0xA, SDLK_z } ,{ 0xB, SDLK_c  },
-        { 0xC, SDLK_4 }, { 0xD, SDLK_r }, { 0xE, SDLK_f  },
-        { 0xF, SDLK_v }
-    };
-
     SDL_Event event;
     while(SDL_PollEvent(&event) != 0)
     {
-        if(event.type == SDL_QUIT) 
+        if(event.type == SDL_QUIT)
             running = false;
-        
-        for(auto[index, key] : Keys)
-        {
-            if(event.key.keysym.sym == key)
-            {   
-                if(event.type == SDL_KEYDOWN)
-                    keypads[index] = 1;
-                 else if(event.type == SDL_KEYUP)
-                    keypads[index] = 0;
-            }
-        }
+
+        // only key events hold a key
+        if(event.type != SDL_KEYDOWN && event.type != SDL_KEYUP)
+            continue;
+
+        const bool pressed = event.type == SDL_KEYDOWN;
+
+        // holding backspace steps back in time
+        if(event.key.keysym.scancode == SDL_SCANCODE_BACKSPACE)
+            rewinding = pressed;
+
+        if(event.key.repeat != 0)
+            continue;
+
+        if(const uint8_t key = keymap.lookup(event.key.keysym.scancode); key != Keymap::NO_KEY)
+            input.push(key, pressed);
     }
 }
 
-void Window::update(std::array<uint32_t, 2048>& display) noexcept
+void Window::wait_event(int timeout_ms) noexcept {
+    SDL_WaitEventTimeout(nullptr, timeout_ms);
+}
+
+void Window::update(const Framebuffer::Packed_display& display, uint32_t dirty_rows) noexcept
 {
+    // the last presented frame is still correct
+    if(dirty_rows == 0 && not overlay_changed)
+        return;
+
+    framebuffer.expand_rows(display, dirty_rows);
+
+    const Framebuffer::Pixels& pixels = framebuffer.get_pixels();
+    const int pitch = sizeof(decltype(pixels[0])) * m_chip_width;
+
+    // upload every run of consecutive dirty rows at once
+    int row = 0;
+    while(row < m_chip_height)
+    {
+        if((dirty_rows >> row & 1) == 0)
+        {
+            row++;
+            continue;
+        }
+
+        int end = row + 1;
+        while(end < m_chip_height && (dirty_rows >> end & 1) != 0)
+            end++;
+
+        const SDL_Rect rect { 0, row, m_chip_width, end - row };
+        SDL_UpdateTexture(texture, &rect, pixels.data() + row * m_chip_width, pitch);
+
+        row = end;
+    }
+
     // clear the the render and assign the texture 
-    SDL_UpdateTexture(texture, nullptr, display.data(), sizeof(decltype(display[0])) * m_chip_width);
     SDL_RenderClear(renderer);
     SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+    draw_overlay();
     SDL_RenderPresent(renderer);
 }
 
+void Window::set_overlay(const float* values, size_t count) noexcept
+{
+    overlay_bars = std::min<size_t>(count, MAX_OVERLAY_BARS);
+    for(size_t i = 0; i < overlay_bars; i++)
+        overlay[i] = std::clamp(values[i], 0.0f, 1.0f);
+
+    overlay_changed = true;
+}
+
+void Window::draw_overlay() noexcept
+{
+    static constexpr std::array<SDL_Color, MAX_OVERLAY_BARS> colors {{
+        { 0x4C, 0xAF, 0x50, 0xFF }, { 0x21, 0x96, 0xF3, 0xFF },
+        { 0xFF, 0xC1, 0x07, 0xFF }, { 0x9E, 0x9E, 0x9E, 0xFF },
+        { 0xF4, 0x43, 0x36, 0xFF }, { 0x9C, 0x27, 0xB0, 0xFF },
+        { 0x00, 0xBC, 0xD4, 0xFF }, { 0xFF, 0x57, 0x22, 0xFF }
+    }};
+
+    overlay_changed = false;
+
+    int width = 0, height = 0;
+    SDL_GetRendererOutputSize(renderer, &width, &height);
+
+    // a full bar is a third of the window wide
+    for(size_t i = 0; i < overlay_bars; i++)
+    {
+        const SDL_Rect bar { 4, 4 + static_cast<int>(i) * 10, static_cast<int>(overlay[i] * width / 3), 6 };
+
+        SDL_SetRenderDrawColor(renderer, colors[i].r, colors[i].g, colors[i].b, colors[i].a);
+        SDL_RenderFillRect(renderer, &bar);
+    }
+
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0xFF);
+}
+
 Window::~Window()
 {
     // free all SDL memory
@@ -7,31 +7,61 @@
 #include <string>
 #include <array>
 
-class Window
+#include "framebuffer.hpp"
+#include "input.hpp"
+#include "renderer.hpp"
+
+class Window final : public Renderer
 {
 public:
     Window(const std::string& str, int width, int height, int chip_width, int chip_height);
-    ~Window();
+    ~Window() override;
+
+    // key repeats are dropped
+    void event_handler(Input_queue& input) noexcept override;
+
+    void set_keymap(const Keymap& map) noexcept override { keymap = map; }
+
+    // only uploads the rows set in `dirty_rows`, nothing is presented
+    // when it's 0 and the overlay didn't change
+    void update(const Framebuffer::Packed_display& display, uint32_t dirty_rows) noexcept override;
+
+    void wait_event(int timeout_ms) noexcept override;
+
+    // drawn from the top left, the next update() presents them even when no row is dirty
+    void set_overlay(const float* values, size_t count) noexcept override;
 
-    void event_handler(std::array<uint8_t, 16>& keypads) noexcept;
-    void update(std::array<uint32_t, 2048>& display) noexcept;
+    enum { MAX_OVERLAY_BARS = 8 };
 
-    constexpr bool is_running() noexcept
+    bool is_running() const noexcept override
     {
         return running;
     }
 
+    bool is_rewinding() const noexcept override
+    {
+        return rewinding;
+    }
+
 private:
+    void draw_overlay() noexcept;
+
     SDL_Window*    window   = nullptr;
     SDL_Renderer*  renderer = nullptr;
     SDL_Texture*   texture  = nullptr;
 
+    Framebuffer framebuffer;
+    Keymap      keymap;
+
     int m_chip_width;
+    int m_chip_height;
 
-    bool running = true;
+    bool running   = true;
+    bool rewinding = false;
 
-    // let chip8 access all of window members
-    friend class Chip8;
+    std::array<float, MAX_OVERLAY_BARS> overlay { };
+    size_t overlay_bars    = 0;
+    bool   overlay_changed = false;
 };
 
 #endif // WINDOW_HPP
\ No newline at end of file